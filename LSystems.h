@@ -7,13 +7,28 @@
 
 #include <fstream>
 #include "L_system.h"
+#include "L_system_forest.h"
 
 namespace octet {
   /// Scene containing a box with octet.
   class LSystems : public app {
   private:
-    // Debug bools
-    enum { LS_DEBUG_PARSER = 1, LS_DEBUG_ITERATE = 1};
+    // memory the tree may use to keep generations and their meshes for O/P
+    enum { GENERATION_CACHE_BYTES = 256 * 1024 * 1024 };
+
+    // detail levels for a distant tree, the projected size in pixels where level 1 starts and the switching margin
+    enum { DETAIL_LEVELS = 3, DETAIL_PIXELS = 256 };
+    float detailHysteresis() const { return 0.2f; }
+
+    // the forest G grows, trees from every grammar scattered in a disc around the tree
+    enum { FOREST_TREES = 2000, FOREST_DEPTH = 4, FOREST_VARIANTS = 8 };
+    float forestRadius() const { return 400.0f; }
+
+    // where finished trees are cached between runs, made on first use and kept out of the checked in assets
+    const char *treeCacheDir() const { return "lsystem_cache"; }
+
+    // where Y writes the tree's profile, open it in chrome://tracing
+    const char *traceFile() const { return "lsystem_trace.json"; }
 
     // scene for drawing box
     ref<visual_scene> app_scene;
@@ -23,6 +38,15 @@ namespace octet {
     ref<L_system> tree;
     dynarray<string> FILENAMES;
 
+    ref<L_system_forest> forest;
+    int forestInstances;      // mesh instances drawing the forest's batches
+    unsigned forestSeed;
+
+    // the tree's phase times and counters, T shows them
+    ref<text_overlay> overlay;
+    ref<mesh_text> profileText;
+    bool showProfile;
+
     void setFileNames(){
       FILENAMES.push_back("assets/Lsystems/Tree1.txt");
       FILENAMES.push_back("assets/Lsystems/Tree2.txt");
@@ -35,20 +59,34 @@ namespace octet {
       FILENAMES.push_back("assets/Lsystems/Tree9.txt");
     }
 
+    /// switches the tree to another grammar, its node, meshes and buffers are reused rather than made again
     void loadNewTree(int index){
-      tree = new L_system();
-      tree->loadFile(FILENAMES[index]);
-      tree->iteration(1);
-      tree->initialiseDrawParams();
-      tree->interpret_axiom();
-      scene_node * testNode = tree->getNode();
-      app_scene->add_child(testNode);
+      if (!tree->switchFile(FILENAMES[index])) return;
+      tree->loadOrBuild(treeCacheDir(), 1);
       app_scene->get_mesh_instance(0)->set_mesh(tree->getMesh());
     }
 
+    /// scatters a new forest and uploads it, the batch meshes are reused so only new batches need mesh instances
+    void growForest(){
+      if (!forest){
+        forest = new L_system_forest();
+        for (int i = 0; i != FILENAMES.size(); ++i){
+          forest->addGrammar(FILENAMES[i]);
+        }
+        app_scene->add_child(forest->getNode());
+      }
+      forest->clearTrees();
+      forest->scatter(FOREST_TREES, forestRadius(), FOREST_DEPTH, FOREST_VARIANTS, ++forestSeed);
+      if (!forest->build()) return;
+      forest->upload();
+      for (; forestInstances < forest->getBatchCount(); ++forestInstances){
+        app_scene->add_mesh_instance(new mesh_instance(forest->getNode(), forest->getBatchMesh(forestInstances), mat));
+      }
+    }
+
   public:
     /// this is called when we construct the class before everything is initialised.
-    LSystems(int argc, char **argv) : app(argc, argv) {
+    LSystems(int argc, char **argv) : app(argc, argv), forestInstances(0), forestSeed(0), showProfile(false) {
     }
 
     /// this is called once OpenGL is initialized
@@ -68,13 +106,30 @@ namespace octet {
 
       tree = new L_system();
       tree->loadFile(FILENAMES[0]);
-      tree->iteration(4);
-      tree->initialiseDrawParams();
-      tree->interpret_axiom();
+      tree->setGenerationCache(GENERATION_CACHE_BYTES, true);
+      tree->setDoubleBuffered(true);
+      tree->setSubtreeCopying(true);
+      tree->setDetailLevels(DETAIL_LEVELS, DETAIL_PIXELS, detailHysteresis());
+      tree->loadOrBuild(treeCacheDir(), 4);
+      tree->setAsync(true);
       scene_node * testNode = tree->getNode();
       app_scene->add_child(testNode);
       app_scene->add_mesh_instance(new mesh_instance(testNode, tree->getMesh(), mat));
 
+      overlay = new text_overlay();
+      aabb bounds(vec3(-150, 150, 0), vec3(256, 200, 0));
+      profileText = new mesh_text(overlay->get_default_font(), "", &bounds);
+      overlay->add_mesh_text(profileText);
+    }
+
+    /// draws the tree's last phase times and counters over the scene
+    void drawProfile(int vx, int vy){
+      char text[1024] = "";
+      tree->getProfile().format(text, sizeof(text));
+      profileText->clear();
+      profileText->format("%s", text);
+      profileText->update();
+      overlay->render(vx, vy);
     }
 
     /// this is called to draw the world
@@ -135,6 +190,52 @@ namespace octet {
         tree->altStochasticity();
       }
 
+      if (is_key_going_down('H')){
+        tree->incrementSides();
+      }
+
+      if (is_key_going_down('J')){
+        tree->decrementSides();
+      }
+
+      if (is_key_going_down('G')){
+        growForest();
+      }
+
+      if (is_key_going_down('T')){
+        showProfile = !showProfile;
+      }
+
+      if (is_key_going_down('Y')){
+        if (tree->writeProfileTrace(traceFile())) printf("profile written to %s\n", traceFile());
+      }
+
+      // a saved edit to the grammar rebuilds the tree where it is, at its generation and with its parameters
+      tree->reloadIfChanged();
+
+      // pick up the worker's latest build, the tree swaps meshes when it is rebuilt, from its cache or its double buffer
+      tree->update();
+
+      // choose the detail level from the tree's size on screen, the worker builds the levels once the tree stops changing
+      // and update() uploads them, until then the full tree is drawn
+      vec3 eye = camera->get_node()->calcModelToWorld()[3].xyz();
+      vec3 centre = (vec4(tree->getBoundsCentre(), 1) * node->calcModelToWorld()).xyz();
+      float distance = (centre - eye).length();
+      float pixels = distance > 0 ? tree->getBoundingRadius() * vy / distance : (float)vy;
+      int level = tree->selectDetail(pixels);
+      if (level > 0 && !tree->getDetailLevels() && tree->isUpToDate()){
+        tree->buildDetailLevels();
+      }
+
+      mesh_instance *instance = app_scene->get_mesh_instance(0);
+      if (instance->get_mesh() != tree->getDetailMesh(level)){
+        instance->set_mesh(tree->getDetailMesh(level));
+      }
+
+      if (showProfile){
+        drawProfile(vx, vy);
+      }
+
       // Camera controls
       if (is_key_down('Q')){
         camera->get_node()->translate(vec3(0, 1.0f, 0));
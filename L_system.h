@@ -10,13 +10,120 @@
 // + - increment or decrement angle around the z axis respectively
 // other letters have no such special meanings
 
-#include "../../octet.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef LS_HEADLESS
+  #include "L_system_headless.h"
+#else
+  #include "../../octet.h"
+#endif
+#include "L_system_parser.h"
+#include "L_system_cache.h"
+#include "L_system_profile.h"
+#include "L_system_pool.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+  #include <emmintrin.h>
+  #define LS_USE_SSE 1
+#else
+  #define LS_USE_SSE 0
+#endif
 
 namespace octet{
   class L_system : public resource{
 
-    /// Debug bools
-    enum { LS_DEBUG_PARSER = 0, LS_DEBUG_ITERATE = 0 };
+    /// smallest number of symbols worth giving to a rewrite thread
+    enum { PARALLEL_MIN_CHUNK = 1 << 16 };
+
+    /// smallest bracketed subtree worth giving to an interpreter thread
+    enum { PARALLEL_MIN_SUBTREE = 1 << 12 };
+
+    /// longest generation, in symbols or parameters, a rewrite will make, a dynarray is indexed by int
+    enum { MAX_SYMBOLS = 0x7fffffff };
+
+    /// deepest generation the generation cache will hold
+    enum { MAX_CACHED_GENERATIONS = 32 };
+
+    /// most vertices in a ring of the tubes, the ring table is sized by it
+    enum { MAX_SIDES = 1 << 10 };
+
+    /// most detail levels a tree keeps, level 0 being the tree itself
+    enum { MAX_DETAIL_LEVELS = 4 };
+
+    /// smallest bracketed subtree the subtree copying mode looks for copies of
+    enum { COPY_MIN_SYMBOLS = 1 << 6 };
+
+    /// the stream of random numbers the stochastic mode jitters with, the rule choices use the generation as theirs
+    enum { JITTER_STREAM = 1 << 20 };
+
+    /// codes a packed string can hold, and the code of a symbol the grammar never reaches
+    enum { PACKED_CODES = 16, PACKED_NONE = 0xff };
+
+    /// how often reloadIfChanged() looks at the grammar file
+    enum { RELOAD_POLL_MS = 250 };
+
+    /// turtle operations, decoded from the symbols once when the grammar is compiled
+    enum turtle_op { OP_NONE, OP_DRAW, OP_PUSH, OP_POP, OP_TURN };
+
+    /// a compiled symbol: where its rewrite lives in the successor pool and what the turtle does with it
+    struct symbol_entry{
+      unsigned successor;     // offset of the rewrite in successorPool, symbols without a rule rewrite to themselves
+      unsigned length;        // length of the rewrite
+      unsigned firstAlternative;  // index of the first weighted successor in alternatives
+      unsigned firstProduction;   // index of the first of its rules with parameters, a condition or a context
+      bool hasRule;
+      uint8_t op;             // turtle_op
+      uint8_t turn;           // index into turns[] for OP_TURN
+      uint8_t numAlternatives;    // weighted successors to choose between, 0 for a plain rule
+      uint8_t numProductions;
+      uint8_t arity;          // parameters the symbol carries in the parameter stream
+      bool isIgnored;         // skipped when looking for a context
+      float stochasticSign;   // sign of the jittered angles in the stochastic mode
+    };
+
+    /// one of a symbol's weighted successors, a symbol's are in order of their cumulative weight
+    struct rule_alternative{
+      unsigned successor;     // offset in successorPool
+      unsigned length;
+      uint64_t threshold;     // chosen when the rule's 32 bit random number is below this, the last is 2^32
+    };
+
+    /// one level of the depth first expansion used when streaming
+    struct derivation_frame{
+      const char *ptr;    // next symbol to emit or expand
+      const char *end;    // end of this level's string
+      int depth;          // rewrites still to apply to the symbols of this level
+    };
+
+    /// everything needed to rewrite one prism or cone without walking the turtle
+    struct segment_frame{
+      vec3 pos0;          // base of the segment, the cone's tip
+      vec3 pos1;          // top of the segment, the cone's ring centre
+      vec3 xAxis;         // turtle x axis, spans the ring with zAxis
+      vec3 zAxis;
+      uint32_t colour;
+      unsigned symbol;    // 1 based index of the F in the axiom, its place on the colour gradient
+      float width;        // multiplies the radius, F's second parameter
+      bool isCone;        // the cone's tip is a point, its ring is never rotated
+      bool isWelded;      // the base ring is the previous segment's top ring, only the top ring is written
+    };
+
+    /// a finished mesh kept by the generation cache or as a detail level
+    struct cached_mesh{
+      ref<mesh> geometry;
+      int vertices;
+      int indices;
+      vec3 boundsMin;     // the box the vertices fill
+      vec3 boundsMax;
+    };
+
+  public:
 
     /// vertex structure
     struct myVertex{
@@ -24,461 +131,3663 @@ namespace octet{
       uint32_t colour;
     };
 
-  private:
+    /// the parameters a key press changes, requested by the app and applied by whoever rebuilds the mesh
+    struct turtle_params{
+      float angle;
+      vec3 translate;
+      float radius;
+      int sides;
+      bool stochastic;
+    };
+
+  private:
+
+    /// CPU side geometry of the current generation, written by the interpreter without a GL context
+    /// the storage is pooled, it only grows and is sized from the exact counts
+    struct mesh_builder{
+      dynarray<myVertex> vertices;
+      dynarray<uint32_t> indices;
+      int numVertices;
+      int numIndices;
+
+      /// makes room for a counted generation, the slack stops small changes reallocating
+      void reserve(int v, int i){
+        if (v > (int)vertices.size()){
+          vertices.reset();
+          vertices.resize(v + v / 4);
+        }
+        if (i > (int)indices.size()){
+          indices.reset();
+          indices.resize(i + i / 4);
+        }
+        numVertices = v;
+        numIndices = i;
+      }
+    };
+
+    /// unit quaternion holding the turtle's orientation, cheaper to push and turn than a matrix
+    struct turtle_quat{
+      float x, y, z, w;
+
+      /// rotation of degrees about local axis 0 (x), 1 (y) or 2 (z), matching mat4t::rotateX/Y/Z
+      static turtle_quat about(int axis, float degrees){
+        float half = degrees * (3.14159265f / 360.0f);
+        float s = sinf(half);
+        turtle_quat q = { axis == 0 ? s : 0, axis == 1 ? s : 0, axis == 2 ? s : 0, cosf(half) };
+        return q;
+      }
+
+      /// applies r in this quaternion's local frame
+      turtle_quat operator*(const turtle_quat &r) const{
+        turtle_quat q = {
+          w * r.x + x * r.w + y * r.z - z * r.y,
+          w * r.y - x * r.z + y * r.w + z * r.x,
+          w * r.z + x * r.y - y * r.x + z * r.w,
+          w * r.w - x * r.x - y * r.y - z * r.z
+        };
+        return q;
+      }
+
+      /// the opposite rotation
+      turtle_quat inverse() const{
+        turtle_quat q = { -x, -y, -z, w };
+        return q;
+      }
+
+      /// takes a vector from the turtle's frame to the world
+      vec3 rotate(const vec3 &v) const{
+        vec3 u(x, y, z);
+        vec3 t = u.cross(v) * 2.0f;
+        return v + t * w + u.cross(t);
+      }
+    };
+
+    /// what [ saves and ] restores
+    struct turtle_state{
+      vec3 pos;
+      turtle_quat rot;
+    };
+
+    /// everything one turtle needs to interpret part of the axiom, the serial path uses one and each worker its own
+    struct turtle_context{
+      myVertex *vtx;                  // next vertex to write
+      uint32_t *idx;                  // next index to write
+      segment_frame *frame;           // next segment frame to record
+      const float *param;             // parameters of the next symbol
+      int numVtxs;                    // number of the next vertex, used by the indices
+      dynarray<turtle_state> stack;   // sized from the deepest bracket nesting, never grows while interpreting
+      dynarray<int> ringStack;        // first vertex of the last ring on each open branch, -1 if there is none
+      int depth;                      // current top of both stacks
+      uint64_t symbolCount;           // symbols in the generation, the length of the colour gradient
+    };
+
+    /// a bracketed subtree big enough to interpret on its own, with the running output totals either side of it
+    struct subtree_task{
+      int begin;                      // the [
+      int end;                        // one past the matching ]
+      int vertexBegin, indexBegin, segmentBegin;
+      int vertexEnd, indexEnd, segmentEnd;
+      int paramBegin, paramEnd;       // where the subtree's parameters are in the parameter stream
+    };
+
+    /// a bracketed subtree the subtree copying mode may copy, group is the first identical subtree in the axiom
+    struct copy_task{
+      subtree_task range;
+      uint64_t hash;                  // of the symbols and whether the subtree grows from a ring
+      int group;
+    };
+
+    /// a subtree waiting for a worker with the turtle state at its opening bracket, task -1 is the whole axiom
+    struct interpret_job{
+      int task;
+      turtle_state state;
+      int ring;
+    };
+
+    /// what rederive_symbol() reads and writes, the old and new expansion lengths are by depth and then symbol
+    struct rederive_state{
+      const char *previous;           // the generation the old rules derived
+      const uint64_t *oldLengths;
+      const uint64_t *newLengths;
+      const uint8_t *changed;         // symbols whose successor changed
+      const int *firstChanged;        // the fewest rewrites after which each symbol's expansion can differ
+      int64_t *written;               // where each depth and symbol was first expanded in dest, -1 if it has not been
+      char *dest;
+      uint64_t size;                  // symbols written
+      uint64_t copied;                // of them, copied from the old string
+    };
+
+    /// holds the background worker between builds for the lifetime of a public call that changes the tree
+    struct worker_pause{
+      L_system *owner;
+      worker_pause(L_system *owner) : owner(owner){ owner->pauseWorker(); }
+      ~worker_pause(){ owner->resumeWorker(); }
+    };
+
+  private:
+
+    // l System variables
+    int fileSize;
+    octet::string message;            // contains the message
+    dynarray<uint8_t> lSystemFile;    // the file, only when octet had to read it rather than it being mapped
+    dynarray<char> alphabet;          // contains the alphabet
+    dynarray<char> axiomBuffers[2];   // double buffered derivation storage
+    dynarray<char> *axiom;            // contains the axiom (current generation)
+    dynarray<char> *nextAxiom;        // derivation target, swapped with axiom
+    dynarray<float> paramBuffers[2];  // the parameters of each symbol of the axiom in order, beside the symbols
+    dynarray<float> *params;
+    dynarray<float> *nextParams;
+    bool isSharedAxiom;               // axiom is another tree's string, see useGeneration()
+    char startingAxiom;               // axiom from file
+    L_system_parser parser;           // kept so the next loadFile() reuses its arrays
+    int plainRules[256];              // each symbol's plain rule in parser.rules, -1 for none
+    symbol_entry symbols[256];        // the compiled grammar, indexed by symbol
+    dynarray<char> successorPool;     // every symbol's rewrite, back to back
+    dynarray<rule_alternative> alternatives;        // the weighted successors, each symbol's back to back
+    dynarray<L_system_parser::rule> weightedRules;  // the weighted rules as parsed, their successors in weightedPool
+    dynarray<char> weightedPool;
+    bool hasAlternatives;             // some symbol has weighted successors, so the derivation depends on the seed
+    dynarray<L_system_parser::production> productions;        // by symbol, then in file order
+    dynarray<char> productionPool;                            // their successors
+    dynarray<L_system_parser::expression> productionArguments;
+    dynarray<L_system_parser::expression_op> expressionCode;
+    dynarray<float> startingParams;   // the parameters of the axiom from file
+    bool hasProductions;              // derivation takes the production path, for rules with parameters, conditions or contexts
+    bool hasContexts;
+    bool hasParameters;               // some symbol has parameters
+
+    // production path scratch, sized with the axiom
+    dynarray<unsigned> paramStarts;   // where each symbol's parameters start
+    dynarray<int> leftContexts;       // each symbol's neighbours, -1 for none
+    dynarray<int> rightContexts;
+    dynarray<int> contextStack;
+    dynarray<int> productionChoices;  // the production each symbol rewrites by, -1 for its plain rule
+    int threadCount;                  // threads used for rewriting, 0 uses every hardware thread
+    L_system_pool ownThreads;         // the threads rewriting and interpretation run on, kept from one build to the next
+    L_system_pool *threadPool;        // ownThreads or a pool shared with a forest or the tree a detail level was built from
+    bool isStreaming;                 // derive symbols on demand instead of storing each generation
+    dynarray<derivation_frame> streamStack;
+    dynarray<uint64_t> streamPositions;   // symbols the stream has passed at each depth, where each is in its generation
+    bool isPacked;                    // store each generation as 4 bit codes instead of chars, see setPacked()
+    dynarray<uint8_t> packedBuffers[2];   // double buffered like axiomBuffers, two codes to a byte with the first in the low nibble
+    dynarray<uint8_t> *packed;        // the current generation when packed
+    dynarray<uint8_t> *nextPacked;
+    unsigned packedLength;            // symbols in *packed
+    uint8_t symbolCodes[256];         // each symbol's code, PACKED_NONE if the grammar cannot reach it
+    char codeSymbols[PACKED_CODES];   // each code's symbol
+    dynarray<uint8_t> codePool;       // successorPool as codes, so the symbol entries and alternatives index both
+    unsigned pairLengths[256];        // what the two codes of a packed byte rewrite to, without weighted rules
+    dynarray<char> generationCache[MAX_CACHED_GENERATIONS];   // derived strings by generation, empty if not cached
+    cached_mesh meshCache[MAX_CACHED_GENERATIONS];            // geometry by generation for the current parameters
+    size_t cacheBudget;               // bytes the generation cache may use, 0 turns it off
+    std::atomic<size_t> cacheBytes;   // bytes the generation cache is using, editParams() drops meshes while the worker reads it
+    bool isCachingGeometry;           // keep each generation's mesh as well as its string
+    float angle;                      // angle used for rotation
+    int iteration_count;
+    bool isQuiet;                     // no parser output, for batch runs
+    L_system_profile profile;         // phase times and counters of this tree's builds
+
+    // drawing variables
+    ref<scene_node> node;
+    ref<mesh> _mesh;
+    ref<mesh> backMesh;       // the next upload's target when double buffered, then swapped with _mesh
+    int backVertices;
+    int backIndices;
+    int backVertexCapacity;
+    int backIndexCapacity;
+    bool isDoubleBuffered;
+    mesh_builder builder;     // the current generation on the CPU, uploaded to _mesh in one step
+    bool meshCurrent;         // _mesh holds all of the current generation, so it may be cached
+    vec3 boundsMin;           // the box _mesh's vertices fill
+    vec3 boundsMax;
+
+    // level of detail, coarser meshes of the current tree for when it is far away
+    ref<L_system> detailTrees[MAX_DETAIL_LEVELS];  // 1 and up, level 0 is this tree, kept with their meshes between rebuilds
+    bool detailDerived;       // the level trees hold the current grammar and generation, so an edit only rebuilds them
+    int numDetailLevels;      // levels uploaded for the current tree including level 0, 0 if they need building
+    int builtDetailLevels;    // levels the last buildDetailBuilders() filled including level 0, what uploadDetailLevels() takes
+    int wantedDetailLevels;
+    int currentDetail;        // the level selectDetail() last chose
+    float detailPixels;       // projected size below which level 1 is used, each further level halves it
+    float detailHysteresis;   // fraction the size must pass a switch point by before the level changes
+
+    // background regeneration, the worker owns the builder and the turtle parameters while isBuilding
+    typedef std::chrono::high_resolution_clock clock;
+    bool isAsync;
+    std::thread worker;
+    std::mutex workerLock;
+    std::condition_variable workerWake;
+    turtle_params pending;                // latest requested parameters, guarded by workerLock
+    std::atomic<int> requestVersion;      // bumped by every request
+    int builtVersion;                     // request the builder or the mesh last caught up with
+    int buildingVersion;                  // request the build in flight was started for
+    bool isBuilding;                      // the worker is writing the builder
+    bool isReady;                         // a finished build is waiting for update()
+    bool isStopping;
+    int pauseDepth;                       // nested worker_pause scopes
+    bool isDetailWanted;                  // buildDetailLevels() asked the worker for the levels
+    int detailVersion;                    // request the levels' builders were built for, -1 if none wait for update()
+    std::atomic<bool> isCancelled;        // the build in flight must stop as soon as it can
+    clock::time_point lastPublish;        // when the worker last finished a build
+    clock::duration lastBuildTime;        // how long that build took
+
+    // hot reload, the grammar file is polled and a saved edit rebuilds the tree where it is
+    string fileName;                      // the grammar last loaded, watched by reloadIfChanged()
+    bool isWatching;                      // fileName is a plain file with a stamp
+    file_stamp fileStamp;
+    clock::time_point lastPoll;
+    float fileAngle;                      // the angle the file gave, a reload only takes the file's angle if it changed
+
+    turtle_context turtle;    // the serial interpreter's state
+    dynarray<uint8_t> countStack;  // whether each open branch has a ring, used when counting vertices
+    dynarray<subtree_task> subtreeTasks;   // large subtrees sorted by their opening bracket, found when counting
+    dynarray<subtree_task> openSubtrees;   // brackets still open while counting
+    dynarray<segment_frame> segmentFrames;   // one per F or ], recorded by interpret_axiom()
+    bool isCopyingSubtrees;                  // copy repeated subtrees instead of interpreting them again
+    dynarray<copy_task> copyTasks;           // subtrees that may repeat, sorted by their opening bracket
+    dynarray<uint64_t> openHashes;           // hashes of the brackets still open while counting
+    dynarray<int> copySources;               // for each group, the subtree interpreted for it or -1
+    dynarray<turtle_state> copyStates;       // the turtle at each interpreted subtree's opening bracket
+    dynarray<int> copyRings;
+    int copiedVertices;                      // vertices the last interpretation wrote as copies
+    int numSegments;          // number of F and ] in the current generation
+    int numVertices;          // vertices and indices _mesh draws
+    int numIndices;
+    int vertexCapacity;       // vertices and indices _mesh's GL buffers hold, a smaller tree reuses them
+    int indexCapacity;
+    int maxBracketDepth;      // deepest bracket nesting in the current generation
+    turtle_quat turns[6];     // +z, -z, +y, -y, +x, -x turns by angle, rebuilt for each interpretation
+    bool countsDirty;         // axiom changed, segments must be recounted and the builder resized
+    bool indicesValid;        // the builder's indices match the current generation
+    bool framesValid;         // segmentFrames matches the current generation and turtle parameters
+    vec3 translateF = vec3(0, 1.0f, 0);
+    float radius = 0.2f;
+    int sides = 3;            // vertices in each ring
+    dynarray<float> ringCos;  // unit cross section, one entry per ring vertex
+    dynarray<float> ringSin;
+
+    // random generation
+    bool isStochastic = false;
+    unsigned seed = 1;        // keys the weighted rule choices and the stochastic mode's jitter
+    float varience = 0.05f;   // maximum percentage variation from original value 
+    int rand = 0;
+    vec3 brown = vec3(1, 0, 0.2f);
+    vec3 green = vec3(0, 0.8f, 1);
+
+    // this function converts three floats into a RGBA 8 bit color, taken from Andy's geometry example
+    static uint32_t make_color(float r, float g, float b) {
+      return 0xff000000 + ((int)(r*255.0f) << 0) + ((int)(g*255.0f) << 8) + ((int)(b*255.0f) << 16);
+    }
+
+    /// the colour of the i'th of size symbols, brown at the root fading to green at the end of the axiom
+    vec3 gradient(uint64_t i, uint64_t size){
+      return green * (float)i / (float)size + brown * (float)(size - i) / (float)size;
+    }
+
+    /// compiles the plain rules into the symbol table and successor pool, called once the rules are parsed
+    /// plainRules indexes grammar's rules, after this neither derivation nor interpretation looks at the parser
+    void compileGrammar(const L_system_parser &grammar){
+      successorPool.resize(0);
+      for (int c = 0; c < 256; ++c){
+        symbol_entry &e = symbols[c];
+        e.hasRule = plainRules[c] >= 0;
+        e.successor = successorPool.size();
+        if (e.hasRule){
+          const L_system_parser::rule &r = grammar.rules[plainRules[c]];
+          e.length = r.length;
+          successorPool.resize(e.successor + e.length);
+          memcpy(&successorPool[e.successor], &grammar.successors[r.offset], e.length);
+        }
+        else{
+          e.length = 1;
+          successorPool.push_back((char)c);
+        }
+        e.firstAlternative = 0;
+        e.numAlternatives = 0;
+        e.firstProduction = 0;
+        e.numProductions = 0;
+        e.arity = 0;
+        e.isIgnored = false;
+        decodeSymbol((char)c, e);
+      }
+      compileAlternatives();
+    }
+
+    /// adds the weighted rules to the symbol table, each symbol's successors with their cumulative weights
+    /// a symbol with a single weighted successor is a plain rule
+    void compileAlternatives(){
+      alternatives.resize(0);
+      for (int c = 0; c < 256; ++c){
+        symbol_entry &e = symbols[c];
+        double total = 0;
+        int count = 0;
+        for (int i = 0; i != weightedRules.size(); ++i){
+          if ((uint8_t)weightedRules[i].symbol == c && count != 255){
+            total += weightedRules[i].weight;
+            ++count;
+          }
+        }
+        if (!count) continue;
+
+        e.hasRule = true;
+        e.firstAlternative = alternatives.size();
+        e.numAlternatives = count > 1 ? (uint8_t)count : 0;
+        double sum = 0;
+        for (int i = 0, k = 0; k != count; ++i){
+          const L_system_parser::rule &r = weightedRules[i];
+          if ((uint8_t)r.symbol != c) continue;
+          sum += r.weight;
+          rule_alternative a = { (unsigned)successorPool.size(), (unsigned)r.length, ++k == count ? (1ull << 32) : (uint64_t)(sum / total * 4294967296.0) };
+          successorPool.resize(a.successor + a.length);
+          memcpy(&successorPool[a.successor], &weightedPool[r.offset], a.length);
+          alternatives.push_back(a);
+        }
+        e.successor = alternatives[e.firstAlternative].successor;
+        e.length = alternatives[e.firstAlternative].length;
+      }
+      hasAlternatives = false;
+      for (int c = 0; c < 256; ++c){
+        if (symbols[c].numAlternatives) hasAlternatives = true;
+      }
+    }
+
+    /// a random number that depends only on the seed, a stream and a position, so any thread can draw it in any order
+    static uint32_t counterRandom(unsigned seed, uint32_t stream, uint64_t position){
+      uint64_t x = position ^ (uint64_t)stream << 40 ^ (uint64_t)seed * 0x9e3779b97f4a7c15ull;
+      for (int i = 0; i != 2; ++i){
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        x ^= x >> 31;
+      }
+      return (uint32_t)(x >> 32);
+    }
+
+    /// picks the weighted successor of a symbol at a position of a generation, the same for every pass over it
+    const rule_alternative &chooseAlternative(const symbol_entry &e, int generation, uint64_t position) const{
+      const rule_alternative *a = &alternatives[e.firstAlternative];
+      uint32_t r = counterRandom(seed, (uint32_t)generation, position);
+      while (r >= a->threshold) ++a;
+      return *a;
+    }
+
+    /// sorts the productions by symbol, keeping the file order of each symbol's, and points the symbols at them
+    void compileProductions(){
+      std::stable_sort(productions.begin(), productions.end(),
+        [](const L_system_parser::production &a, const L_system_parser::production &b){ return (uint8_t)a.symbol < (uint8_t)b.symbol; });
+      hasContexts = hasParameters = false;
+      for (int i = 0; i != productions.size(); ++i){
+        symbol_entry &e = symbols[(uint8_t)productions[i].symbol];
+        if (!e.numProductions) e.firstProduction = i;
+        if (e.numProductions != 255) ++e.numProductions;
+        if (productions[i].left || productions[i].right) hasContexts = true;
+      }
+      for (int c = 0; c < 256; ++c){
+        if (symbols[c].arity) hasParameters = true;
+      }
+      hasProductions = productions.size() || hasParameters;
+    }
+
+    /// finds each symbol's neighbours for the context sensitive rules in one pass each way
+    /// a neighbour skips the ignored symbols and whole branches, the first symbol of a branch sees the symbol before it
+    void findContexts(const char *src, unsigned size){
+      leftContexts.resize(size);
+      rightContexts.resize(size);
+      contextStack.resize(0);
+      int last = -1;
+      for (unsigned i = 0; i != size; ++i){
+        const symbol_entry &e = symbols[(uint8_t)src[i]];
+        leftContexts[i] = -1;
+        if (e.op == OP_PUSH){
+          contextStack.push_back(last);
+        }
+        else if (e.op == OP_POP){
+          if (contextStack.size()){
+            last = contextStack.back();
+            contextStack.pop_back();
+          }
+        }
+        else{
+          leftContexts[i] = last;
+          if (!e.isIgnored) last = (int)i;
+        }
+      }
+
+      contextStack.resize(0);
+      int next = -1;
+      for (unsigned i = size; i-- != 0;){
+        const symbol_entry &e = symbols[(uint8_t)src[i]];
+        rightContexts[i] = -1;
+        if (e.op == OP_POP){
+          contextStack.push_back(next);
+          next = -1;
+        }
+        else if (e.op == OP_PUSH){
+          if (contextStack.size()){
+            next = contextStack.back();
+            contextStack.pop_back();
+          }
+        }
+        else{
+          rightContexts[i] = next;
+          if (!e.isIgnored) next = (int)i;
+        }
+      }
+    }
+
+    /// gathers the parameters a production of the symbol at i names, the left context's, the symbol's and the right context's
+    void bindParameters(const L_system_parser::production &p, unsigned i, float *values) const{
+      const float *param = params->data();
+      int n = 0;
+      for (int j = 0; j != p.leftBound; ++j){
+        values[n++] = param[paramStarts[leftContexts[i]] + j];
+      }
+      for (int j = 0; j != symbols[(uint8_t)p.symbol].arity; ++j){
+        values[n++] = param[paramStarts[i] + j];
+      }
+      for (int j = 0; j != p.rightBound; ++j){
+        values[n++] = param[paramStarts[rightContexts[i]] + j];
+      }
+    }
+
+    /// returns the first production of the symbol at i whose context and condition hold, -1 if none does
+    int matchProduction(const char *src, unsigned i) const{
+      const symbol_entry &e = symbols[(uint8_t)src[i]];
+      for (unsigned k = e.firstProduction; k != e.firstProduction + e.numProductions; ++k){
+        const L_system_parser::production &p = productions[k];
+        if (p.left && (leftContexts[i] < 0 || src[leftContexts[i]] != p.left)) continue;
+        if (p.right && (rightContexts[i] < 0 || src[rightContexts[i]] != p.right)) continue;
+        if (p.condition.length){
+          float values[L_system_parser::MAX_PARAMETERS];
+          bindParameters(p, i, values);
+          if (L_system_parser::evaluate(&expressionCode[p.condition.first], p.condition.length, values) == 0) continue;
+        }
+        return (int)k;
+      }
+      return -1;
+    }
+
+    /// chooses the rule of each symbol in [begin, end) and counts the symbols and parameters they rewrite to
+    void countProductions(const char *src, unsigned begin, unsigned end, uint64_t &length, uint64_t &numParams){
+      length = numParams = 0;
+      for (unsigned i = begin; i != end; ++i){
+        const symbol_entry &e = symbols[(uint8_t)src[i]];
+        int k = e.numProductions ? matchProduction(src, i) : -1;
+        productionChoices[i] = k;
+        if (k >= 0){
+          length += productions[k].length;
+          numParams += productions[k].numArguments;
+        }
+        else if (e.hasRule){
+          length += e.numAlternatives ? chooseAlternative(e, iteration_count, i).length : e.length;
+        }
+        else{
+          length += 1;
+          numParams += e.arity;
+        }
+      }
+    }
+
+    /// rewrites the symbols in [begin, end) by the rules countProductions() chose, evaluating the new parameters
+    /// a symbol without a rule keeps its parameters, a plain rule's successor has none
+    void writeProductions(const char *src, unsigned begin, unsigned end, char *dest, float *destParams){
+      const char *pool = successorPool.data();
+      const float *param = params->data();
+      for (unsigned i = begin; i != end; ++i){
+        const symbol_entry &e = symbols[(uint8_t)src[i]];
+        int k = productionChoices[i];
+        if (k >= 0){
+          const L_system_parser::production &p = productions[k];
+          memcpy(dest, &productionPool[p.offset], p.length);
+          dest += p.length;
+          if (p.numArguments){
+            float values[L_system_parser::MAX_PARAMETERS];
+            bindParameters(p, i, values);
+            for (int a = 0; a != p.numArguments; ++a){
+              const L_system_parser::expression &x = productionArguments[p.firstArgument + a];
+              *destParams++ = L_system_parser::evaluate(&expressionCode[x.first], x.length, values);
+            }
+          }
+        }
+        else if (e.hasRule){
+          unsigned successor = e.successor, length = e.length;
+          if (e.numAlternatives){
+            const rule_alternative &a = chooseAlternative(e, iteration_count, i);
+            successor = a.successor;
+            length = a.length;
+          }
+          memcpy(dest, pool + successor, length);
+          dest += length;
+        }
+        else{
+          *dest++ = src[i];
+          for (int j = 0; j != e.arity; ++j){
+            *destParams++ = param[paramStarts[i] + j];
+          }
+        }
+      }
+    }
+
+    /// rewrites the axiom and its parameters into the back buffers with the productions
+    /// the rules are chosen for the whole string first, then the chunks are counted and written like iterate_parallel()
+    /// returns false and leaves the back buffers alone if the next generation would be too long
+    bool iterate_productions(){
+      const char *src = axiom->data();
+      unsigned size = axiom->size();
+      paramStarts.resize(size);
+      unsigned numParams = 0;
+      for (unsigned i = 0; i != size; ++i){
+        paramStarts[i] = numParams;
+        numParams += symbols[(uint8_t)src[i]].arity;
+      }
+      if (hasContexts) findContexts(src, size);
+      productionChoices.resize(size);
+
+      int chunks = getChunkCount(size);
+      dynarray<uint64_t> offsets, paramOffsets;
+      offsets.resize(chunks + 1);
+      paramOffsets.resize(chunks + 1);
+      runParallel(chunks, [&](int i){
+        unsigned begin = (unsigned)((uint64_t)size * i / chunks), end = (unsigned)((uint64_t)size * (i + 1) / chunks);
+        countProductions(src, begin, end, offsets[i + 1], paramOffsets[i + 1]);
+      });
+
+      offsets[0] = paramOffsets[0] = 0;
+      for (int i = 0; i < chunks; ++i){
+        offsets[i + 1] += offsets[i];
+        paramOffsets[i + 1] += paramOffsets[i];
+      }
+      if (!fitsGeneration(offsets[chunks]) || !fitsGeneration(paramOffsets[chunks])) return false;
+      nextAxiom->resize((unsigned)offsets[chunks]);
+      nextParams->resize((unsigned)paramOffsets[chunks]);
+      char *dest = nextAxiom->data();
+      float *destParams = nextParams->data();
+
+      runParallel(chunks, [&](int i){
+        unsigned begin = (unsigned)((uint64_t)size * i / chunks), end = (unsigned)((uint64_t)size * (i + 1) / chunks);
+        writeProductions(src, begin, end, dest + offsets[i], destParams + paramOffsets[i]);
+      });
+      return true;
+    }
+
+    /// sets the turtle operation of a symbol, see the top of this file
+    static void decodeSymbol(char c, symbol_entry &e){
+      static const char turnSymbols[] = "+-<>^*";
+      static const float turnSigns[] = { 1, -1, 1, -1, -1, -1 };
+
+      e.op = OP_NONE;
+      e.turn = 0;
+      e.stochasticSign = 1;
+      switch (c){
+      case 'F': e.op = OP_DRAW; break;
+      case '[': e.op = OP_PUSH; break;
+      case ']': e.op = OP_POP; break;
+      default:
+        for (int i = 0; i != 6; ++i){
+          if (c == turnSymbols[i]){
+            e.op = OP_TURN;
+            e.turn = i;
+            e.stochasticSign = turnSigns[i];
+          }
+        }
+        break;
+      }
+    }
+
+    /// returns the exact length of the next generation of a string, position is where src starts in the axiom
+    uint64_t countExpansion(const char *src, unsigned size, unsigned position){
+      uint64_t length = 0;
+      if (!hasAlternatives){
+        for (unsigned i = 0; i != size; ++i){
+          length += symbols[(uint8_t)src[i]].length;
+        }
+        return length;
+      }
+      for (unsigned i = 0; i != size; ++i){
+        const symbol_entry &e = symbols[(uint8_t)src[i]];
+        length += e.numAlternatives ? chooseAlternative(e, iteration_count, position + i).length : e.length;
+      }
+      return length;
+    }
+
+    /// rewrites a string into a buffer that has been sized with countExpansion()
+    void writeExpansion(const char *src, unsigned size, char *dest, unsigned position){
+      const char *pool = successorPool.data();
+      for (unsigned i = 0; i != size; ++i){
+        const symbol_entry &e = symbols[(uint8_t)src[i]];
+        unsigned successor = e.successor, length = e.length;
+        if (e.numAlternatives){
+          const rule_alternative &a = chooseAlternative(e, iteration_count, position + i);
+          successor = a.successor;
+          length = a.length;
+        }
+        if (length == 1){
+          *dest++ = pool[successor];
+        }
+        else{
+          memcpy(dest, pool + successor, length);
+          dest += length;
+        }
+      }
+    }
+
+    /// runs job(0) ... job(count - 1) with a thread each from the tree's pool, the calling thread among them
+    template <class job_t> void runParallel(int count, job_t job){
+      threadPool->run(count, count, [&](int i, int){ job(i); });
+    }
+
+    /// returns the number of chunks to split a rewrite of size symbols into
+    int getChunkCount(unsigned size){
+      int threads = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+      int chunks = (int)(size / PARALLEL_MIN_CHUNK);
+      return chunks < threads ? (chunks > 0 ? chunks : 1) : threads;
+    }
+
+    /// splits the axiom into chunks, prefix sums their output lengths and expands them concurrently into one buffer
+    /// the result is byte identical to the serial rewrite as every chunk writes to the same place it would have
+    /// and the weighted rules are chosen by each symbol's position, not by the order they are reached in
+    /// returns false and leaves the back buffer alone if the next generation would be too long
+    bool iterate_parallel(int chunks){
+      const char *src = axiom->data();
+      unsigned size = axiom->size();
+      dynarray<uint64_t> offsets;
+      offsets.resize(chunks + 1);
+
+      runParallel(chunks, [&](int i){
+        unsigned begin = (unsigned)((uint64_t)size * i / chunks), end = (unsigned)((uint64_t)size * (i + 1) / chunks);
+        offsets[i + 1] = countExpansion(src + begin, end - begin, begin);
+      });
+
+      offsets[0] = 0;
+      for (int i = 0; i < chunks; ++i){
+        offsets[i + 1] += offsets[i];
+      }
+
+      if (!fitsGeneration(offsets[chunks])) return false;
+      nextAxiom->resize((unsigned)offsets[chunks]);
+      char *dest = nextAxiom->data();
+
+      runParallel(chunks, [&](int i){
+        unsigned begin = (unsigned)((uint64_t)size * i / chunks), end = (unsigned)((uint64_t)size * (i + 1) / chunks);
+        writeExpansion(src + begin, end - begin, dest + offsets[i], begin);
+      });
+      return true;
+    }
+
+    /// returns true if a generation of length symbols or parameters can be stored, says why not if it can not
+    bool fitsGeneration(uint64_t length){
+      if (length <= MAX_SYMBOLS) return true;
+      if (!isQuiet) printf("Generation %d would be %llu long, more than the %d a tree holds, so it is not derived\n",
+        iteration_count + 1, (unsigned long long)length, (int)MAX_SYMBOLS);
+      return false;
+    }
+
+    /// This function iterates once over an L-system
+    /// the first pass counts the exact output size, the second writes into the back buffer which then becomes the axiom
+    /// returns false and keeps the current generation if the next one would be longer than MAX_SYMBOLS
+    bool iterate(){
+      if (isStreaming){
+        // the stream expands the starting axiom on demand, so there is nothing to store
+        invalidateCounts();
+        ++iteration_count;
+        return true;
+      }
+
+      LS_PROFILE_PHASE(profile, L_system_profile::PHASE_DERIVE, iteration_count + 1);
+      if (LS_DEBUG_ITERATE) printf("Iterate started\n");
+
+      if (isPacked){
+        if (!iterate_packed()) return false;
+        invalidateCounts();
+        if (LS_DEBUG_ITERATE) printf("Generation %d, %u packed symbols\n", iteration_count + 1, packedLength);
+        LS_PROFILE_COUNT(profile, L_system_profile::COUNT_SYMBOLS, packedLength);
+        LS_PROFILE_COUNT(profile, L_system_profile::COUNT_BYTES, memoryBytes());
+        ++iteration_count;
+        return true;
+      }
+
+      int chunks = getChunkCount(axiom->size());
+      if (hasProductions){
+        if (!iterate_productions()) return false;
+      }
+      else if (chunks > 1){
+        if (!iterate_parallel(chunks)) return false;
+      }
+      else{
+        uint64_t length = countExpansion(axiom->data(), axiom->size(), 0);
+        if (!fitsGeneration(length)) return false;
+        nextAxiom->resize((unsigned)length);
+        writeExpansion(axiom->data(), axiom->size(), nextAxiom->data(), 0);
+      }
+      invalidateCounts();
+
+      dynarray<char> *temp = axiom;
+      axiom = nextAxiom;
+      // a shared string is only ever read, the next rewrite goes to this tree's other buffer
+      nextAxiom = isSharedAxiom ? &axiomBuffers[axiom == &axiomBuffers[0]] : temp;
+      dynarray<float> *tempParams = params;
+      params = nextParams;
+      nextParams = isSharedAxiom ? &paramBuffers[params == &paramBuffers[0]] : tempParams;
+      isSharedAxiom = false;
+
+      // a deep generation is millions of symbols, show how many and how they start
+      if (LS_DEBUG_ITERATE) printf("Generation %d, %d symbols: %.*s\n", iteration_count + 1, axiom->size(), axiom->size() < 80 ? axiom->size() : 80, axiom->data());
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_SYMBOLS, axiom->size());
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_BYTES, memoryBytes());
+      ++iteration_count;
+      storeGeneration();
+      return true;
+    }
+
+    /// the original single pass rewrite, one resize per symbol, kept as the reference for benchmarkIteration()
+    /// it knows nothing of the weighted rules
+    void iterate_reference(dynarray<char> &src, dynarray<char> &new_array){
+      int location;
+      new_array.resize(0);
+
+      for (char c : src){
+        const symbol_entry &e = symbols[(uint8_t)c];
+        location = new_array.size();
+        new_array.resize(new_array.size() + e.length);
+        memcpy(&new_array[location], &successorPool[e.successor], e.length);
+      }
+    }
+
+    /// counts the symbols of the current generation that have a non zero weight without deriving it
+    /// count[d][c] is the weighted number of symbols c becomes after d rewrites
+    uint64_t countDerivedSymbols(const uint8_t *weight){
+      int depth = isStreaming ? iteration_count : 0;
+      if (hasAlternatives && depth){
+        // what a symbol becomes depends on where it is, so the stream has to be walked
+        uint64_t total = 0;
+        beginStream();
+        for (char c = nextStreamSymbol(); c; c = nextStreamSymbol()){
+          total += weight[(uint8_t)c];
+        }
+        return total;
+      }
+
+      uint64_t count[2][256];
+      for (int c = 0; c < 256; ++c){
+        count[0][c] = weight[c];
+      }
+
+      for (int d = 1; d <= depth; ++d){
+        uint64_t *prev = count[(d - 1) & 1], *cur = count[d & 1];
+        for (int c = 0; c < 256; ++c){
+          if (symbols[c].hasRule){
+            const char *rhs = &successorPool[symbols[c].successor];
+            cur[c] = 0;
+            for (unsigned i = 0; i != symbols[c].length; ++i){
+              cur[c] += prev[(uint8_t)rhs[i]];
+            }
+          }
+          else{
+            cur[c] = prev[c];
+          }
+        }
+      }
+
+      uint64_t total = 0;
+      for (char c : *axiom){
+        total += count[depth & 1][(uint8_t)c];
+      }
+      return total;
+    }
+
+    /// starts a depth first expansion of the axiom, this is the whole of the stream's memory
+    void beginStream(){
+      int depth = isStreaming ? iteration_count : 0;
+      streamStack.resize(0);
+      streamStack.reserve(depth + 1);
+      streamPositions.resize(depth + 1);
+      for (int d = 0; d <= depth; ++d){
+        streamPositions[d] = 0;
+      }
+      derivation_frame root = { axiom->data(), axiom->data() + axiom->size(), depth };
+      streamStack.push_back(root);
+    }
+
+    /// returns the next symbol of the current generation, or 0 when the stream is finished
+    /// depth first order keeps each generation's symbols in order, so a count per depth is each symbol's position
+    char nextStreamSymbol(){
+      while (streamStack.size()){
+        derivation_frame &frame = streamStack.back();
+        if (frame.ptr == frame.end){
+          streamStack.pop_back();
+          continue;
+        }
+
+        char c = *frame.ptr++;
+        uint64_t position = streamPositions[frame.depth]++;
+        const symbol_entry &e = symbols[(uint8_t)c];
+        if (frame.depth == 0 || !e.hasRule){
+          // a symbol without a rule is itself in every later generation, where it moves the positions along too
+          if (hasAlternatives){
+            for (int d = 0; d < frame.depth; ++d){
+              ++streamPositions[d];
+            }
+          }
+          return c;
+        }
+
+        unsigned successor = e.successor, length = e.length;
+        if (e.numAlternatives){
+          const rule_alternative &a = chooseAlternative(e, iteration_count - frame.depth, position);
+          successor = a.successor;
+          length = a.length;
+        }
+        const char *rhs = successorPool.data() + successor;
+        derivation_frame child = { rhs, rhs + length, frame.depth - 1 };
+        streamStack.push_back(child);
+      }
+      return 0;
+    }
+
+    /// gives each symbol the starting axiom can derive a dense code, returns false if there are more than PACKED_CODES
+    bool compileCodes(){
+      bool reached[256] = {};
+      uint8_t pending[256];
+      int numPending = 0, numCodes = 0;
+      reached[(uint8_t)startingAxiom] = true;
+      pending[numPending++] = (uint8_t)startingAxiom;
+      auto reach = [&](unsigned successor, unsigned length){
+        for (unsigned i = 0; i != length; ++i){
+          uint8_t c = (uint8_t)successorPool[successor + i];
+          if (!reached[c]){
+            reached[c] = true;
+            pending[numPending++] = c;
+          }
+        }
+      };
+      while (numPending){
+        const symbol_entry &e = symbols[pending[--numPending]];
+        // every successor the symbol may choose, a weighted symbol's plain rule is never used
+        if (!e.numAlternatives) reach(e.successor, e.length);
+        for (int a = 0; a != e.numAlternatives; ++a){
+          reach(alternatives[e.firstAlternative + a].successor, alternatives[e.firstAlternative + a].length);
+        }
+      }
+
+      for (int c = 0; c != 256; ++c){
+        symbolCodes[c] = PACKED_NONE;
+        if (!reached[c]) continue;
+        if (numCodes == PACKED_CODES) return false;
+        codeSymbols[numCodes] = (char)c;
+        symbolCodes[c] = (uint8_t)numCodes++;
+      }
+      for (int code = numCodes; code != PACKED_CODES; ++code){
+        codeSymbols[code] = startingAxiom;
+      }
+
+      codePool.resize(successorPool.size());
+      for (int i = 0; i != successorPool.size(); ++i){
+        codePool[i] = symbolCodes[(uint8_t)successorPool[i]];
+      }
+      for (int b = 0; b != 256; ++b){
+        pairLengths[b] = symbols[(uint8_t)codeSymbols[b & 15]].length + symbols[(uint8_t)codeSymbols[b >> 4]].length;
+      }
+      return true;
+    }
+
+    /// returns the symbol at i of a packed string
+    char packedSymbol(const uint8_t *src, unsigned i) const{
+      return codeSymbols[(src[i >> 1] >> ((i & 1) << 2)) & 15];
+    }
+
+    /// packs the char axiom into this tree's packed buffer and frees the chars, the codes must be compiled
+    void packAxiom(){
+      ownAxiom();
+      packedLength = axiom->size();
+      packed->resize((packedLength + 1) / 2);
+      uint8_t *dest = packed->data();
+      const char *src = axiom->data();
+      for (unsigned i = 0; i < packedLength; i += 2){
+        uint8_t hi = i + 1 < packedLength ? symbolCodes[(uint8_t)src[i + 1]] : 0;
+        dest[i >> 1] = symbolCodes[(uint8_t)src[i]] | hi << 4;
+      }
+      axiomBuffers[0].reset();
+      axiomBuffers[1].reset();
+    }
+
+    /// writes the current packed generation out as chars
+    void unpackInto(dynarray<char> &text) const{
+      text.resize(packedLength);
+      const uint8_t *src = packed->data();
+      for (unsigned i = 0; i != packedLength; ++i){
+        text[i] = packedSymbol(src, i);
+      }
+    }
+
+    /// returns where in the successor and code pools the packed symbol with this code at position rewrites from
+    unsigned packedSuccessor(uint8_t code, unsigned position, unsigned &length){
+      const symbol_entry &e = symbols[(uint8_t)codeSymbols[code]];
+      if (e.numAlternatives){
+        const rule_alternative &a = chooseAlternative(e, iteration_count, position);
+        length = a.length;
+        return a.successor;
+      }
+      length = e.length;
+      return e.successor;
+    }
+
+    /// returns the exact length of the next generation of the packed symbols [begin, end), begin is even
+    uint64_t countPacked(const uint8_t *src, unsigned begin, unsigned end){
+      uint64_t length = 0;
+      unsigned i = begin;
+      if (!hasAlternatives){
+        for (; i + 2 <= end; i += 2){
+          length += pairLengths[src[i >> 1]];
+        }
+      }
+      for (; i != end; ++i){
+        unsigned count;
+        packedSuccessor((src[i >> 1] >> ((i & 1) << 2)) & 15, i, count);
+        length += count;
+      }
+      return length;
+    }
+
+    /// the codes at the ends of a chunk's packed output that share a byte with its neighbours
+    struct packed_edge{
+      uint8_t first;    // the code at the chunk's first position, when that is the high nibble of a shared byte
+      uint8_t last;     // the code at the chunk's last position, when that is the low nibble of a shared byte
+    };
+
+    /// rewrites the packed symbols [begin, end) into dest from code position start, sized with countPacked()
+    /// the bytes the chunk shares with its neighbours are left for iterate_packed() to put together
+    void writePacked(const uint8_t *src, unsigned begin, unsigned end, uint8_t *dest, unsigned start, packed_edge &edge){
+      const uint8_t *pool = codePool.data();
+      unsigned pos = start;
+      uint8_t low = 0;
+      for (unsigned i = begin; i != end; ++i){
+        unsigned length, successor = packedSuccessor((src[i >> 1] >> ((i & 1) << 2)) & 15, i, length);
+        for (unsigned k = 0; k != length; ++k, ++pos){
+          uint8_t code = pool[successor + k];
+          if (!(pos & 1)) low = code;
+          else if (pos != start) dest[pos >> 1] = low | code << 4;
+          else edge.first = code;
+        }
+      }
+      edge.last = low;
+    }
+
+    /// rewrites the packed generation in chunks, on as many threads as the plain rewrite would use
+    /// chunks start on even symbols so each reads whole bytes, and the output bytes two chunks share are filled in afterwards
+    /// returns false and leaves the back buffer alone if the next generation would be too long
+    bool iterate_packed(){
+      const uint8_t *src = packed->data();
+      unsigned size = packedLength;
+      int chunks = getChunkCount(size);
+      dynarray<uint64_t> offsets;
+      dynarray<packed_edge> edges;
+      offsets.resize(chunks + 1);
+      edges.resize(chunks);
+      auto chunkStart = [&](int i){ return i == chunks ? size : (unsigned)((uint64_t)size * i / chunks) & ~1u; };
+
+      runParallel(chunks, [&](int i){
+        offsets[i + 1] = countPacked(src, chunkStart(i), chunkStart(i + 1));
+      });
+
+      offsets[0] = 0;
+      for (int i = 0; i < chunks; ++i){
+        offsets[i + 1] += offsets[i];
+      }
+
+      if (!fitsGeneration(offsets[chunks])) return false;
+      nextPacked->resize((unsigned)((offsets[chunks] + 1) / 2));
+      uint8_t *dest = nextPacked->data();
+
+      runParallel(chunks, [&](int i){
+        writePacked(src, chunkStart(i), chunkStart(i + 1), dest, (unsigned)offsets[i], edges[i]);
+      });
+
+      uint8_t low = 0;
+      for (int i = 0; i != chunks; ++i){
+        unsigned begin = (unsigned)offsets[i], end = (unsigned)offsets[i + 1];
+        if (begin == end) continue;
+        if (begin & 1) dest[begin >> 1] = low | edges[i].first << 4;
+        if (end & 1) low = edges[i].last;
+      }
+      if (offsets[chunks] & 1) dest[offsets[chunks] >> 1] = low;
+
+      std::swap(packed, nextPacked);
+      packedLength = (unsigned)offsets[chunks];
+      return true;
+    }
+
+    /// sets the axiom back to the starting symbol
+    void resetAxiom(){
+      invalidateCounts();
+      ownAxiom();
+      iteration_count = 0;
+      axiom->resize(0);
+      axiom->push_back(startingAxiom);
+      copyArray(*params, startingParams);
+      if (isPacked) packAxiom();
+    }
+
+    /// copies an array of plain values
+    template <class value_t> static void copyArray(dynarray<value_t> &to, const dynarray<value_t> &from){
+      to.resize(from.size());
+      if (to.size()) memcpy(to.data(), from.data(), sizeof(value_t) * to.size());
+    }
+
+    /// points the axiom back at one of this tree's buffers before it is overwritten, after useGeneration()
+    void ownAxiom(){
+      if (!isSharedAxiom) return;
+      axiom = nextAxiom == &axiomBuffers[0] ? &axiomBuffers[1] : &axiomBuffers[0];
+      params = nextParams == &paramBuffers[0] ? &paramBuffers[1] : &paramBuffers[0];
+      isSharedAxiom = false;
+    }
+
+    /// This function makes a parsed grammar the L - System's, starting again from its axiom
+    void applyGrammar(const L_system_parser &grammar){
+      message = grammar.message;
+      alphabet.resize(grammar.alphabet.size());
+      memcpy(alphabet.data(), grammar.alphabet.data(), alphabet.size());
+
+      startingAxiom = grammar.axiom;
+      copyArray(startingParams, grammar.axiomParameters);
+
+      // a plain rule replaces every earlier rule for its symbol, a weighted one adds to the earlier weighted ones
+      // and takes over from a plain one
+      for (int c = 0; c < 256; ++c){
+        plainRules[c] = -1;
+      }
+      weightedRules.resize(0);
+      weightedPool.resize(0);
+      for (int i = 0; i != grammar.rules.size(); ++i){
+        const L_system_parser::rule &r = grammar.rules[i];
+        if (LS_DEBUG_PARSER) printf("%c = {%g} %.*s\n", r.symbol, r.weight, r.length, &grammar.successors[r.offset]);
+        int kept = 0;
+        for (int w = 0; w != weightedRules.size(); ++w){
+          if (r.weight > 0 || weightedRules[w].symbol != r.symbol) weightedRules[kept++] = weightedRules[w];
+        }
+        weightedRules.resize(kept);
+        if (r.weight > 0){
+          L_system_parser::rule weighted = { r.symbol, (int)weightedPool.size(), r.length, r.weight };
+          weightedPool.resize(weighted.offset + r.length);
+          memcpy(&weightedPool[weighted.offset], &grammar.successors[r.offset], r.length);
+          weightedRules.push_back(weighted);
+        }
+        else{
+          plainRules[(uint8_t)r.symbol] = i;
+        }
+      }
+      compileGrammar(grammar);
+
+      // the rules with parameters, conditions or contexts keep their successors and compiled expressions
+      copyArray(productions, grammar.productions);
+      copyArray(productionPool, grammar.successors);
+      copyArray(productionArguments, grammar.arguments);
+      copyArray(expressionCode, grammar.code);
+      for (int i = 0; i != productions.size(); ++i){
+        const L_system_parser::production &p = productions[i];
+        if (LS_DEBUG_PARSER) printf("%c < %c > %c = %.*s\n", p.left ? p.left : '*', p.symbol, p.right ? p.right : '*', p.length, &productionPool[p.offset]);
+      }
+      for (int c = 0; c < 256; ++c){
+        symbols[c].arity = (uint8_t)grammar.arity[c];
+      }
+      for (int i = 0; i != grammar.ignored.size(); ++i){
+        symbols[(uint8_t)grammar.ignored[i]].isIgnored = true;
+      }
+      compileProductions();
+      // a streamed string has no parameters and no neighbours to match, nor does a packed one
+      if (hasProductions) isStreaming = false;
+      if (isPacked && (hasProductions || !compileCodes())) isPacked = false;
+      resetAxiom();
+
+      angle = grammar.angle;
+      if (LS_DEBUG_PARSER) printf("The Angle is: %g\n", angle);
+
+      if (!isQuiet){
+        printf("Here is the message: %s\n", message.c_str());
+        printf("Here is the Alphabet: %.*s\n", alphabet.size(), alphabet.data());
+        printf("Here is the Axiom: %c\n", startingAxiom);
+      }
+    }
+
+    /// takes another tree's compiled grammar and settings, not its generation, mesh or caches
+    void copyGrammar(const L_system &from){
+      memcpy(symbols, from.symbols, sizeof(symbols));
+      successorPool.resize(from.successorPool.size());
+      memcpy(successorPool.data(), from.successorPool.data(), successorPool.size());
+      alternatives.resize(from.alternatives.size());
+      memcpy(alternatives.data(), from.alternatives.data(), sizeof(rule_alternative) * alternatives.size());
+      hasAlternatives = from.hasAlternatives;
+      copyArray(productions, from.productions);
+      copyArray(productionPool, from.productionPool);
+      copyArray(productionArguments, from.productionArguments);
+      copyArray(expressionCode, from.expressionCode);
+      copyArray(startingParams, from.startingParams);
+      hasProductions = from.hasProductions;
+      hasContexts = from.hasContexts;
+      hasParameters = from.hasParameters;
+      startingAxiom = from.startingAxiom;
+      isQuiet = true;
+      isStreaming = from.isStreaming;
+      isPacked = false;
+      isCopyingSubtrees = from.isCopyingSubtrees;
+      threadCount = from.threadCount;
+      seed = from.seed;
+      varience = from.varience;
+      brown = from.brown;
+      green = from.green;
+      resetAxiom();
+    }
+
+    /// moves to a generation of a tree with the same grammar, copying its string from the other tree's cache where it can
+    void deriveFrom(const L_system &from, int generation){
+      if (!isStreaming && generation < MAX_CACHED_GENERATIONS && from.generationCache[generation].size()){
+        const dynarray<char> &text = from.generationCache[generation];
+        ownAxiom();
+        axiom->resize(text.size());
+        memcpy(axiom->data(), text.data(), text.size());
+        iteration_count = generation;
+        invalidateCounts();
+        return;
+      }
+      iteration(generation - iteration_count);
+    }
+
+    /// fills lengths with how long every symbol's expansion is after each number of rewrites up to generations
+    /// by the given symbol table and pool, a length past 4G symbols is held there
+    static void expansionLengths(const symbol_entry *table, const char *pool, int generations, dynarray<uint64_t> &lengths){
+      lengths.resize((generations + 1) * 256);
+      for (int c = 0; c != 256; ++c){
+        lengths[c] = 1;
+      }
+      for (int d = 1; d <= generations; ++d){
+        const uint64_t *below = &lengths[(d - 1) * 256];
+        uint64_t *here = &lengths[d * 256];
+        for (int c = 0; c != 256; ++c){
+          const symbol_entry &e = table[c];
+          uint64_t length = 0;
+          for (unsigned k = 0; k != e.length; ++k){
+            length += below[(uint8_t)pool[e.successor + k]];
+          }
+          here[c] = length < 0xffffffffull ? length : 0xffffffffull;
+        }
+      }
+    }
+
+    /// writes the expansion of c by depth rewrites, previousAt is where the old rules put the same expansion or -1
+    void rederive_symbol(rederive_state &state, uint8_t c, int depth, int64_t previousAt){
+      uint64_t length = state.newLengths[depth * 256 + c];
+      if (previousAt >= 0 && depth < state.firstChanged[c]){
+        // no changed rule is reached in time, the old expansion is the new one
+        memcpy(state.dest + state.size, state.previous + previousAt, (size_t)length);
+        state.size += length;
+        state.copied += length;
+        return;
+      }
+      int64_t &first = state.written[depth * 256 + c];
+      if (first >= 0){
+        memcpy(state.dest + state.size, state.dest + first, (size_t)length);
+        state.size += length;
+        return;
+      }
+      if (depth == 0){
+        state.dest[state.size++] = (char)c;
+        return;
+      }
+
+      first = (int64_t)state.size;
+      const symbol_entry &e = symbols[c];
+      // an unchanged successor leaves each child's expansion where it was
+      if (state.changed[c]) previousAt = -1;
+      for (unsigned k = 0; k != e.length; ++k){
+        uint8_t child = (uint8_t)successorPool[e.successor + k];
+        rederive_symbol(state, child, depth - 1, previousAt);
+        if (previousAt >= 0) previousAt += state.oldLengths[(depth - 1) * 256 + child];
+      }
+    }
+
+    /// derives the given generation of the new plain rules from previous, the same generation of the old ones
+    /// an expansion no changed rule can reach in the rewrites left is copied from where it was in previous, and an
+    /// expansion of a symbol to a depth already written is copied from its first, so each changed expansion is made once
+    /// returns false and leaves the axiom alone if the string would be too long
+    bool rederive(const dynarray<char> &previous, const symbol_entry *previousSymbols, const dynarray<char> &previousPool,
+      int generation, char previousAxiom){
+      dynarray<uint64_t> oldLengths, newLengths;
+      expansionLengths(previousSymbols, previousPool.data(), generation, oldLengths);
+      expansionLengths(symbols, successorPool.data(), generation, newLengths);
+      uint64_t size = newLengths[generation * 256 + (uint8_t)startingAxiom];
+      if (size > MAX_SYMBOLS) return false;
+
+      uint8_t changed[256];
+      int firstChanged[256];
+      for (int c = 0; c != 256; ++c){
+        const symbol_entry &a = previousSymbols[c], &b = symbols[c];
+        changed[c] = a.length != b.length || memcmp(previousPool.data() + a.successor, successorPool.data() + b.successor, b.length);
+        firstChanged[c] = changed[c] ? 1 : generation + 1;
+      }
+      // an unchanged symbol's expansion changes one rewrite after the soonest of its successor's
+      for (bool moved = true; moved;){
+        moved = false;
+        for (int c = 0; c != 256; ++c){
+          if (changed[c]) continue;
+          const symbol_entry &e = symbols[c];
+          for (unsigned k = 0; k != e.length; ++k){
+            int soonest = firstChanged[(uint8_t)successorPool[e.successor + k]] + 1;
+            if (soonest < firstChanged[c]){
+              firstChanged[c] = soonest;
+              moved = true;
+            }
+          }
+        }
+      }
+
+      LS_PROFILE_PHASE(profile, L_system_profile::PHASE_DERIVE, generation);
+      dynarray<int64_t> written;
+      written.resize((generation + 1) * 256);
+      for (int i = 0; i != written.size(); ++i){
+        written[i] = -1;
+      }
+
+      ownAxiom();
+      nextAxiom->resize((unsigned)size);
+      rederive_state state = { previous.data(), oldLengths.data(), newLengths.data(), changed, firstChanged, written.data(), nextAxiom->data(), 0, 0 };
+      // previous is only a guide if it is what the old rules derived from the same axiom
+      bool guided = previousAxiom == startingAxiom && (uint64_t)previous.size() == oldLengths[generation * 256 + (uint8_t)startingAxiom];
+      rederive_symbol(state, (uint8_t)startingAxiom, generation, guided ? 0 : -1);
+
+      dynarray<char> *temp = axiom;
+      axiom = nextAxiom;
+      nextAxiom = temp;
+      iteration_count = generation;
+      invalidateCounts();
+      if (LS_DEBUG_ITERATE) printf("Generation %d re-derived, %u symbols, %llu copied from the old string\n", generation, axiom->size(), (unsigned long long)state.copied);
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_SYMBOLS, axiom->size());
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_BYTES, memoryBytes());
+      return true;
+    }
+
+    /// the projected size in pixels below which a level is used
+    float detailSwitch(int level){
+      return detailPixels / (float)(1 << (level - 1));
+    }
+
+    /// this function returns a randomised slighlty altered copy of the original
+    /// the random number is keyed by the symbol's index in the axiom and which of its draws this is, not drawn in turn,
+    /// so any thread interpreting the symbol gets the same value
+    float mutateFloat(uint64_t symbol, int draw, float input){
+      float r = (float)(counterRandom(seed, JITTER_STREAM + draw, symbol) >> 8) * (1.0f / 16777216);
+      return input * (1 - varience + 2 * varience * r);
+    }
+
+  public:
+
+    /// default constructer
+    L_system(){
+      axiom = &axiomBuffers[0];
+      nextAxiom = &axiomBuffers[1];
+      params = &paramBuffers[0];
+      nextParams = &paramBuffers[1];
+      isSharedAxiom = false;
+      hasProductions = hasContexts = hasParameters = false;
+      node = new scene_node();
+      _mesh = new mesh();
+      numSegments = numVertices = numIndices = -1;
+      backVertices = backIndices = -1;
+      vertexCapacity = indexCapacity = backVertexCapacity = backIndexCapacity = -1;
+      isDoubleBuffered = false;
+      builder.numVertices = builder.numIndices = 0;
+      isAsync = isBuilding = isReady = isStopping = false;
+      requestVersion = builtVersion = buildingVersion = 0;
+      pauseDepth = 0;
+      isDetailWanted = false;
+      detailVersion = -1;
+      isCancelled = false;
+      lastBuildTime = clock::duration::zero();
+      maxBracketDepth = 0;
+      invalidateCounts();
+      iteration_count = 0;
+      threadCount = 0;
+      threadPool = &ownThreads;
+      isStreaming = false;
+      isPacked = false;
+      packed = &packedBuffers[0];
+      nextPacked = &packedBuffers[1];
+      packedLength = 0;
+      hasAlternatives = false;
+      cacheBudget = cacheBytes = 0;
+      isCachingGeometry = false;
+      isQuiet = false;
+      isCopyingSubtrees = false;
+      copiedVertices = 0;
+      isWatching = false;
+      fileAngle = 0;
+      boundsMin = boundsMax = vec3(0, 0, 0);
+      numDetailLevels = builtDetailLevels = currentDetail = 0;
+      wantedDetailLevels = 1;
+      detailPixels = 256;
+      detailHysteresis = 0.2f;
+      buildRingTable();
+      for (int c = 0; c < 256; ++c){
+        plainRules[c] = -1;
+      }
+      compileGrammar(parser);
+    }
+
+    ~L_system(){
+      stopWorker();
+    }
+
+  private:
+
+    /// These functions are to be used with the new framework ----------------------
+    /// they build the mesh and run the worker, the app reaches them through the functions after parseFile()
+
+    /// fills the unit cross section table so ring vertices need no trig
+    void buildRingTable(){
+      ringCos.resize(sides);
+      ringSin.resize(sides);
+      for (int i = 0; i < sides; ++i) {
+        float theta = i * 2.0f * 3.14159265f / sides;
+        ringCos[i] = cosf(theta);
+        ringSin[i] = sinf(theta);
+      }
+    }
+
+    /// writes a prism's rings, only the top one if it is welded to the segment below, or a cone's tip and ring
+    /// the axes are scaled by the radius once per segment, the colour was packed when the frame was made
+    myVertex *write_segment_vertices(const segment_frame &f, myVertex *vtx){
+      vec3 xr = f.xAxis * (radius * f.width);
+      vec3 zr = f.zAxis * (radius * f.width);
+
+    #if LS_USE_SSE
+      // a myVertex is exactly one 16 byte register: xyz from the maths, w from the colour bits
+      static_assert(sizeof(myVertex) == 16, "myVertex must stay 16 bytes for the SSE writer");
+      __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+      __m128 colour = _mm_castsi128_ps(_mm_set_epi32((int)f.colour, 0, 0, 0));
+      __m128 x = _mm_set_ps(0, xr[2], xr[1], xr[0]);
+      __m128 z = _mm_set_ps(0, zr[2], zr[1], zr[0]);
+      __m128 p0 = _mm_set_ps(0, f.pos0[2], f.pos0[1], f.pos0[0]);
+      __m128 p1 = _mm_set_ps(0, f.pos1[2], f.pos1[1], f.pos1[0]);
+
+      if (f.isCone){
+        _mm_storeu_ps((float*)vtx++, _mm_or_ps(_mm_and_ps(p0, mask), colour));
+      }
+      else if (!f.isWelded){
+        for (int i = 0; i < sides; ++i) {
+          __m128 offset = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(ringCos[i])), _mm_mul_ps(z, _mm_set1_ps(ringSin[i])));
+          _mm_storeu_ps((float*)vtx++, _mm_or_ps(_mm_and_ps(_mm_add_ps(p0, offset), mask), colour));
+        }
+      }
+      for (int i = 0; i < sides; ++i) {
+        __m128 offset = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(ringCos[i])), _mm_mul_ps(z, _mm_set1_ps(ringSin[i])));
+        _mm_storeu_ps((float*)vtx++, _mm_or_ps(_mm_and_ps(_mm_add_ps(p1, offset), mask), colour));
+      }
+    #else
+      if (f.isCone){
+        vtx->pos = f.pos0;
+        vtx->colour = f.colour;
+        vtx++;
+      }
+      else if (!f.isWelded){
+        for (int i = 0; i < sides; ++i) {
+          vtx->pos = f.pos0 + xr * ringCos[i] + zr * ringSin[i];
+          vtx->colour = f.colour;
+          vtx++;
+        }
+      }
+      for (int i = 0; i < sides; ++i) {
+        vtx->pos = f.pos1 + xr * ringCos[i] + zr * ringSin[i];
+        vtx->colour = f.colour;
+        vtx++;
+      }
+    #endif
+      return vtx;
+    }
+
+    /// writes the vertices of a run of cached segment frames
+    myVertex *write_segment_batch(const segment_frame *frames, int count, myVertex *vtx){
+      for (int i = 0; i != count; ++i){
+        vtx = write_segment_vertices(frames[i], vtx);
+      }
+      return vtx;
+    }
+
+    /// makes the strip of triangles joining two rings of sides vertices
+    uint32_t *write_tube_indices(uint32_t *idx, uint32_t base, uint32_t top){
+      if (indicesValid) return idx + 6 * sides;
+
+      for (int i = 0; i != sides; ++i) {
+        /*
+        top + i ---- top + j
+        |          / |
+        |       /    |
+        |    /       |
+        base + i --- base + j
+        */
+        uint32_t j = (i + 1) % sides;
+        idx[0] = base + i;
+        idx[1] = top + j;
+        idx[2] = top + i;
+        idx[3] = base + i;
+        idx[4] = base + j;
+        idx[5] = top + j;
+        idx += 6;
+      }
+      return idx;
+    }
+
+    /// makes the fan of triangles joining a cone's tip to its ring
+    uint32_t *write_cone_indices(uint32_t *idx, uint32_t tip, uint32_t ring){
+      if (indicesValid) return idx + 3 * sides;
+
+      for (int i = 0; i != sides; ++i) {
+        idx[0] = tip;
+        idx[1] = ring + (i + 1) % sides;
+        idx[2] = ring + i;
+        idx += 3;
+      }
+      return idx;
+    }
+
+    /// this function calculates the vertices of a prism given a matrix from the matrix stack 
+    /// consecutive prisms on a branch share the ring where they meet
+    /// This code has been taken from Andy's geometery example and modified
+    /// the colour comes from symbol, the prism's F's 1 based index in the axiom
+    /// an F with parameters is param[0] segments long and param[1] times as wide
+    void calculate_prism_vertices(turtle_context &t, uint64_t symbol, int arity, const float *param){
+
+      turtle_state &state = t.stack[t.depth];
+      vec3 pos0 = state.pos;
+      vec3 step = arity ? translateF * param[0] : translateF;
+      if (isStochastic){
+        step[1] = mutateFloat(symbol, 0, step[1]);
+      }
+      state.pos += state.rot.rotate(step);
+
+      int base = t.ringStack[t.depth];
+
+      // the only place the orientation becomes axes
+      segment_frame &f = *t.frame++;
+      f.pos0 = pos0;
+      f.pos1 = state.pos;
+      f.xAxis = state.rot.rotate(vec3(1, 0, 0));
+      f.zAxis = state.rot.rotate(vec3(0, 0, 1));
+      vec3 colour = gradient(symbol, t.symbolCount);
+      f.colour = make_color(colour[0], colour[1], colour[2]);
+      f.symbol = (unsigned)symbol;
+      f.width = arity > 1 ? param[1] : 1;
+      f.isCone = false;
+      f.isWelded = base >= 0;
+      t.vtx = write_segment_vertices(f, t.vtx);
+
+      if (base < 0){
+        base = t.numVtxs;
+        t.numVtxs += sides;
+      }
+      t.idx = write_tube_indices(t.idx, base, t.numVtxs);
+      t.ringStack[t.depth] = t.numVtxs;
+      t.numVtxs += sides;
+    }
+
+    // this function calculates the vertices required for a downwards facing cone ~ a leafish
+    void calculate_cone_vertices(turtle_context &t){
+
+      vec3 pos0 = t.stack[t.depth].pos;
+
+      segment_frame &f = *t.frame++;
+      f.pos0 = pos0;
+      f.pos1 = vec3(pos0[0], pos0[1] - 0.5f, pos0[2]);
+      f.xAxis = vec3(1, 0, 0);
+      f.zAxis = vec3(0, 0, 1);
+      f.colour = make_color(0, 1.0f, 0.5f);
+      f.symbol = 0;
+      f.width = 1;
+      f.isCone = true;
+      f.isWelded = false;
+      t.vtx = write_segment_vertices(f, t.vtx);
+
+      t.idx = write_cone_indices(t.idx, t.numVtxs, t.numVtxs + 1);
+      t.numVtxs += sides + 1;
+    }
+
+    /// fills the table of turns by the current angle
+    void buildTurnTable(){
+      for (int axis = 0; axis != 3; ++axis){
+        turns[(2 - axis) * 2] = turtle_quat::about(axis, angle);
+        turns[(2 - axis) * 2 + 1] = turtle_quat::about(axis, -angle);
+      }
+    }
+
+    /// turns the turtle, by the precomputed turn or by three jittered turns about each axis in the stochastic mode
+    void turn(turtle_context &t, int index, float stochasticAngle, uint64_t symbol){
+      turtle_quat &rot = t.stack[t.depth].rot;
+      if (!isStochastic){
+        rot = rot * turns[index];
+      }
+      else{
+        rot = rot * turtle_quat::about(0, mutateFloat(symbol, 0, stochasticAngle));
+        rot = rot * turtle_quat::about(1, mutateFloat(symbol, 1, stochasticAngle));
+        rot = rot * turtle_quat::about(2, mutateFloat(symbol, 2, stochasticAngle));
+      }
+    }
+
+    /// turns the turtle by a symbol's own angle, about the same axis and in the same sense as turns[index]
+    void turnBy(turtle_context &t, int index, float degrees, float stochasticSign, uint64_t symbol){
+      if (isStochastic){
+        turn(t, index, stochasticSign * degrees, symbol);
+        return;
+      }
+      turtle_quat &rot = t.stack[t.depth].rot;
+      rot = rot * turtle_quat::about(2 - index / 2, index & 1 ? -degrees : degrees);
+    }
+
+    /// puts the turtle at the start of a range, the stacks are sized for the deepest nesting so they never grow
+    void beginTurtle(turtle_context &t, const turtle_state &start, int ring){
+      t.stack.resize(maxBracketDepth + 1);
+      t.ringStack.resize(maxBracketDepth + 1);
+      t.stack[0] = start;
+      t.ringStack[0] = ring;
+      t.depth = 0;
+    }
+
+    /// returns the turtle at the root, upright at the origin
+    static turtle_state rootState(){
+      turtle_state state = { vec3(0, 0, 0), { 0, 0, 0, 1 } };
+      return state;
+    }
+
+    /// applies a single symbol, the i'th of the axiom counting from 1, to the turtle, emitting geometry where needed
+    void interpret_symbol(turtle_context &t, char c, uint64_t i){
+      const symbol_entry &e = symbols[(uint8_t)c];
+      const float *param = t.param;
+      t.param += e.arity;
+      switch (e.op){
+      case OP_DRAW:
+        // draw a prism
+        calculate_prism_vertices(t, i, e.arity, param);
+        break;
+      case OP_PUSH:
+        // push the state onto the stack, the branch may grow from the parent's last ring
+        t.stack[t.depth + 1] = t.stack[t.depth];
+        t.ringStack[t.depth + 1] = t.ringStack[t.depth];
+        ++t.depth;
+        break;
+      case OP_POP:
+        // pop the state off the stack
+        calculate_cone_vertices(t);
+        if (t.depth > 0) --t.depth;
+        break;
+      case OP_TURN:
+        // + - about z, < > about y, ^ * about x, by the symbol's parameter if it has one
+        if (e.arity) turnBy(t, e.turn, param[0], e.stochasticSign, i);
+        else turn(t, e.turn, e.stochasticSign * angle, i);
+        break;
+      default:
+        break;
+      }
+    }
+
+    /// interprets one job's range of the axiom, handing the large subtrees inside it back to the pool
+    template <class spawn_t> void interpret_range(turtle_context &t, const interpret_job &job,
+      myVertex *vertices, uint32_t *indices, spawn_t spawn){
+      const char *src = axiom->data();
+      unsigned size = axiom->size();
+      int begin = 0, end = (int)size, next = 0;
+      int vertexBegin = 0, indexBegin = 0, segmentBegin = 0, paramBegin = 0;
+
+      if (job.task >= 0){
+        const subtree_task &task = subtreeTasks[job.task];
+        begin = task.begin;
+        end = task.end;
+        next = job.task + 1;
+        vertexBegin = task.vertexBegin;
+        indexBegin = task.indexBegin;
+        segmentBegin = task.segmentBegin;
+        paramBegin = task.paramBegin;
+      }
+
+      t.vtx = vertices + vertexBegin;
+      t.idx = indices + indexBegin;
+      t.frame = segmentFrames.data() + segmentBegin;
+      t.param = params->data() + paramBegin;
+      t.numVtxs = vertexBegin;
+      t.symbolCount = size;
+      beginTurtle(t, job.state, job.ring);
+
+      for (int p = begin; p < end; ++p){
+        if (((p - begin) & 4095) == 0 && buildCancelled()) return;
+        if (next < (int)subtreeTasks.size() && subtreeTasks[next].begin == p){
+          const subtree_task &child = subtreeTasks[next];
+          interpret_job childJob = { next, t.stack[t.depth], t.ringStack[t.depth] };
+          spawn(childJob);
+
+          // carry on after the subtree as if it had been interpreted here
+          p = child.end - 1;
+          t.vtx = vertices + child.vertexEnd;
+          t.idx = indices + child.indexEnd;
+          t.frame = segmentFrames.data() + child.segmentEnd;
+          t.param = params->data() + child.paramEnd;
+          t.numVtxs = child.vertexEnd;
+          for (++next; next < (int)subtreeTasks.size() && subtreeTasks[next].begin < child.end; ++next);
+          continue;
+        }
+
+        interpret_symbol(t, src[p], p + 1);
+      }
+    }
+
+    /// interprets the axiom on the tree's thread pool, each subtree writes to the slice of the buffers the count pass gave it
+    /// the output matches the serial interpreter, the stochastic mode's jitter is keyed by each symbol's index
+    void interpret_parallel(int threads, myVertex *vertices, uint32_t *indices){
+      std::mutex lock;
+      std::condition_variable wake;
+      std::deque<interpret_job> queue;
+      int outstanding = 1;
+
+      interpret_job root = { -1, rootState(), -1 };
+      queue.push_back(root);
+
+      auto spawn = [&](const interpret_job &job){
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(job);
+        ++outstanding;
+        wake.notify_one();
+      };
+
+      runParallel(threads, [&](int){
+        turtle_context t;
+        for (;;){
+          interpret_job job;
+          {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]{ return !queue.empty() || outstanding == 0; });
+            if (queue.empty()) return;
+            job = queue.front();
+            queue.pop_front();
+          }
+
+          interpret_range(t, job, vertices, indices, spawn);
+
+          std::lock_guard<std::mutex> guard(lock);
+          if (--outstanding == 0) wake.notify_all();
+        }
+      });
+    }
+
+    /// true if the subtree copying mode's subtree to can be a copy of the earlier subtree from
+    bool subtreesMatch(int from, int to, int ring){
+      const subtree_task &a = copyTasks[from].range, &b = copyTasks[to].range;
+      const char *src = axiom->data();
+      return a.end - a.begin == b.end - b.begin && (copyRings[from] < 0) == (ring < 0) &&
+        !memcmp(src + a.begin, src + b.begin, a.end - a.begin);
+    }
+
+    /// writes subtree to as a copy of the identical subtree from, moving its frames to the turtle and renumbering its indices
+    /// the frames are moved rather than the vertices so the copy can be rewritten from the frames like the rest of the tree
+    void copy_subtree(turtle_context &t, int from, int to, myVertex *vertices, uint32_t *indices){
+      const subtree_task &a = copyTasks[from].range, &b = copyTasks[to].range;
+      const turtle_state &start = copyStates[from], &here = t.stack[t.depth];
+      turtle_quat rot = here.rot * start.rot.inverse();
+      vec3 offset = here.pos - rot.rotate(start.pos);
+      unsigned shift = (unsigned)(b.begin - a.begin);
+
+      // the rotation as a matrix is half the work of the quaternion for every point it moves
+      vec3 mx = rot.rotate(vec3(1, 0, 0)), my = rot.rotate(vec3(0, 1, 0)), mz = rot.rotate(vec3(0, 0, 1));
+
+      const segment_frame *f = segmentFrames.data() + a.segmentBegin;
+      segment_frame *g = segmentFrames.data() + b.segmentBegin;
+      for (int n = a.segmentEnd - a.segmentBegin; n != 0; --n, ++f, ++g){
+        *g = *f;
+        g->pos0 = offset + mx * f->pos0[0] + my * f->pos0[1] + mz * f->pos0[2];
+        if (f->isCone){
+          // leaves hang straight down whichever way the branch points
+          g->pos1 = vec3(g->pos0[0], g->pos0[1] - 0.5f, g->pos0[2]);
+        }
+        else{
+          g->pos1 = offset + mx * f->pos1[0] + my * f->pos1[1] + mz * f->pos1[2];
+          g->xAxis = mx * f->xAxis[0] + my * f->xAxis[1] + mz * f->xAxis[2];
+          g->zAxis = mx * f->zAxis[0] + my * f->zAxis[1] + mz * f->zAxis[2];
+          g->symbol = f->symbol + shift;
+          vec3 colour = gradient(g->symbol, t.symbolCount);
+          g->colour = make_color(colour[0], colour[1], colour[2]);
+        }
+      }
+      write_segment_batch(segmentFrames.data() + b.segmentBegin, b.segmentEnd - b.segmentBegin, vertices + b.vertexBegin);
+
+      if (!indicesValid){
+        // indices inside the source move with it, the rest are the ring the source grew from
+        uint32_t vertexShift = (uint32_t)(b.vertexBegin - a.vertexBegin);
+        uint32_t ringShift = (uint32_t)(t.ringStack[t.depth] - copyRings[from]);
+        const uint32_t *in = indices + a.indexBegin;
+        uint32_t *out = indices + b.indexBegin;
+        for (int n = a.indexEnd - a.indexBegin; n != 0; --n){
+          uint32_t v = *in++;
+          *out++ = v + (v >= (uint32_t)a.vertexBegin ? vertexShift : ringShift);
+        }
+      }
+
+      copiedVertices += a.vertexEnd - a.vertexBegin;
+
+      // carry on after the subtree as if it had been interpreted here
+      t.vtx = vertices + b.vertexEnd;
+      t.idx = indices + b.indexEnd;
+      t.frame = segmentFrames.data() + b.segmentEnd;
+      t.numVtxs = b.vertexEnd;
+    }
+
+    /// interprets the axiom once per distinct subtree, every repeat of a subtree is a moved copy of its first occurrence
+    /// the copies land where the count pass put them, so the output matches interpret_into() to rounding
+    void interpret_copying(myVertex *vertices, uint32_t *indices){
+      const char *src = axiom->data();
+      int size = axiom->size();
+      int count = copyTasks.size();
+      copySources.resize(count);
+      copyStates.resize(count);
+      copyRings.resize(count);
+      for (int i = 0; i != count; ++i){
+        copySources[i] = -1;
+      }
+
+      turtle.vtx = vertices;
+      turtle.idx = indices;
+      turtle.frame = segmentFrames.data();
+      turtle.param = params->data();
+      turtle.numVtxs = 0;
+      turtle.symbolCount = size;
+      beginTurtle(turtle, rootState(), -1);
+
+      int next = 0;
+      for (int p = 0; p < size; ++p){
+        if ((p & 4095) == 0 && buildCancelled()) return;
+        if (next < count && copyTasks[next].range.begin == p){
+          int group = copyTasks[next].group, from = copySources[group];
+          int ring = turtle.ringStack[turtle.depth];
+          if (from >= 0 && subtreesMatch(from, next, ring)){
+            int end = copyTasks[next].range.end;
+            copy_subtree(turtle, from, next, vertices, indices);
+            p = end - 1;
+            for (++next; next < count && copyTasks[next].range.begin < end; ++next);
+            continue;
+          }
+
+          // the first of its kind, remember where it starts so later ones can be moved onto it
+          if (from < 0) copySources[group] = next;
+          copyStates[next] = turtle.stack[turtle.depth];
+          copyRings[next] = ring;
+          ++next;
+        }
+        interpret_symbol(turtle, src[p], p + 1);
+      }
+    }
+
+    /// interprets the axiom into buffers sized by countGeometry(), they need not belong to a mesh
+    void interpret_into(myVertex *vertices, uint32_t *indices){
+      LS_PROFILE_PHASE(profile, L_system_profile::PHASE_INTERPRET, iteration_count);
+      buildTurnTable();
+      // a cancelled pass leaves the frames half written
+      framesValid = false;
+      copiedVertices = 0;
+
+      // both read the axiom as chars, so neither takes a packed or streamed string whatever task lists are left over
+      if (isCopyingSubtrees && !isStochastic && !isStreaming && !isPacked && copyTasks.size()){
+        interpret_copying(vertices, indices);
+        if (!isCancelled) indicesValid = framesValid = true;
+        return;
+      }
+
+      int threads = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+      if (!isStreaming && !isPacked && threads > 1 && subtreeTasks.size()){
+        interpret_parallel(threads, vertices, indices);
+        if (!isCancelled) indicesValid = framesValid = true;
+        return;
+      }
+
+      turtle.vtx = vertices;
+      turtle.idx = indices;
+      turtle.frame = segmentFrames.data();
+      turtle.param = params->data();
+      turtle.numVtxs = 0;
+      beginTurtle(turtle, rootState(), -1);
+
+      if (isStreaming){
+        // pull the symbols straight from the rules, the final string never exists
+        uint8_t all[256];
+        memset(all, 1, sizeof(all));
+        turtle.symbolCount = countDerivedSymbols(all);
+        uint64_t i = 0;
+
+        beginStream();
+        for (char c = nextStreamSymbol(); c; c = nextStreamSymbol()){
+          if ((i & 4095) == 0 && buildCancelled()) return;
+          interpret_symbol(turtle, c, ++i);
+        }
+        indicesValid = framesValid = true;
+        return;
+      }
+
+      if (isPacked){
+        const uint8_t *src = packed->data();
+        turtle.symbolCount = packedLength;
+        for (unsigned i = 0; i != packedLength; ++i){
+          if ((i & 4095) == 0 && buildCancelled()) return;
+          interpret_symbol(turtle, packedSymbol(src, i), i + 1);
+        }
+        indicesValid = framesValid = true;
+        return;
+      }
+
+      int i = 0;
+      turtle.symbolCount = axiom->size();
+      
+      // for each char in axiom do x
+      for (char c : *axiom)
+      {
+        if ((i & 4095) == 0 && buildCancelled()) return;
+        interpret_symbol(turtle, c, ++i);
+      }
+      indicesValid = framesValid = true;
+    }
+
+    /// This function interprets the axiom into the builder and uploads it to the mesh
+    void interpret_axiom(){
+      interpret_into(builder.vertices.data(), builder.indices.data());
+      uploadGeometry();
+    }
+
+    /// hands the builder's geometry to the mesh in one copy, the GL buffers are only reallocated when the size changes
+    /// when double buffered the copy goes to the mesh that is not being drawn, which then becomes the current mesh
+    void uploadGeometry(){
+      uploadBuffers(builder.vertices.data(), builder.indices.data(), builder.numVertices, builder.numIndices);
+    }
+
+    /// copies finished geometry into the mesh, from the builder or straight from a mapped cache file
+    void uploadBuffers(const myVertex *vertices, const uint32_t *indices, int vertexCount, int indexCount){
+      LS_PROFILE_PHASE(profile, L_system_profile::PHASE_UPLOAD, iteration_count);
+      if (isDoubleBuffered){
+        ref<mesh> front = _mesh;
+        _mesh = backMesh;
+        backMesh = front;
+        std::swap(numVertices, backVertices);
+        std::swap(numIndices, backIndices);
+        std::swap(vertexCapacity, backVertexCapacity);
+        std::swap(indexCapacity, backIndexCapacity);
+      }
+
+      if (vertexCount > vertexCapacity || indexCount > indexCapacity){
+        // the same slack as the builder, so the next tree or generation of about this size fits
+        vertexCapacity = vertexCount + vertexCount / 4;
+        indexCapacity = indexCount + indexCount / 4;
+        allocateMesh(_mesh, vertexCount, indexCount, vertexCapacity, indexCapacity);
+      }
+      else if (vertexCount != numVertices || indexCount != numIndices){
+        _mesh->set_params(sizeof(myVertex), indexCount, vertexCount, GL_TRIANGLES, GL_UNSIGNED_INT);
+      }
+      numVertices = vertexCount;
+      numIndices = indexCount;
+
+      copyToMesh(_mesh, vertices, indices, numVertices, numIndices);
+      measureBounds(vertices, numVertices, boundsMin, boundsMax);
+      meshCurrent = true;
+    }
+
+    /// finds the box that count vertices fill, an empty mesh is a point at the origin
+    static void measureBounds(const myVertex *vertices, int count, vec3 &min, vec3 &max){
+      float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+      for (int i = 0; i != count; ++i){
+        const float *p = (const float *)&vertices[i].pos;
+        for (int j = 0; j != 3; ++j){
+          float v = p[j];
+          if (i == 0 || v < lo[j]) lo[j] = v;
+          if (i == 0 || v > hi[j]) hi[j] = v;
+        }
+      }
+      min = vec3(lo[0], lo[1], lo[2]);
+      max = vec3(hi[0], hi[1], hi[2]);
+    }
+
+    /// This fucntion sets up the builder for the current generation, taken and edited from Andy's geometry example
+    /// the segment count and buffers are kept until the axiom changes, so parameter tweaks only rewrite vertices
+    void initialiseDrawParams() {
+
+      if (!countsDirty) return;
+
+      LS_PROFILE_PHASE(profile, L_system_profile::PHASE_COUNT, iteration_count);
+      int vertices = 0, indices = 0;
+      countGeometry(vertices, indices);
+      builder.reserve(vertices, indices);
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_SEGMENTS, numSegments);
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_VERTICES, vertices);
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_STACK_DEPTH, maxBracketDepth);
+      LS_PROFILE_COUNT(profile, L_system_profile::COUNT_BYTES, memoryBytes());
+
+      countsDirty = false;
+      indicesValid = framesValid = false;
+    }
+
+    /// counts the vertices and indices the current generation needs and sizes the segment frames
+    /// for a stored axiom it also notes the large bracketed subtrees and where their output starts and ends
+    /// and, when copying subtrees, hashes every subtree so the repeats can be found
+    void countGeometry(int &vertices, int &indices){
+      int segments = 0;
+      vertices = indices = 0;
+      maxBracketDepth = 0;
+      countStack.resize(0);
+      countStack.push_back(0);
+      if (isStreaming){
+        beginStream();
+        for (char c = nextStreamSymbol(); c; c = nextStreamSymbol()){
+          count_symbol(c, segments, vertices, indices);
+        }
+      }
+      else if (isPacked){
+        // no subtrees are noted, so a packed string is interpreted on one thread and never copied
+        subtreeTasks.resize(0);
+        copyTasks.resize(0);
+        const uint8_t *src = packed->data();
+        for (unsigned i = 0; i != packedLength; ++i){
+          count_symbol(packedSymbol(src, i), segments, vertices, indices);
+        }
+      }
+      else{
+        subtreeTasks.resize(0);
+        openSubtrees.resize(0);
+        copyTasks.resize(0);
+        // the hashes are of the symbols alone, so trees with parameters are never copied
+        bool copying = isCopyingSubtrees && !isStochastic && !hasParameters;
+        const char *src = axiom->data();
+        int parameters = 0;
+        for (int p = 0; p != axiom->size(); ++p){
+          uint8_t op = symbols[(uint8_t)src[p]].op;
+          if (op == OP_PUSH){
+            subtree_task open = { p, 0, vertices, indices, segments, 0, 0, 0, parameters, 0 };
+            openSubtrees.push_back(open);
+            // a subtree growing from a ring writes fewer vertices than the same symbols without one
+            if (copying) openHashes.push_back(L_system_cache_hash().value ^ countStack.back());
+          }
+          count_symbol(src[p], segments, vertices, indices);
+          parameters += symbols[(uint8_t)src[p]].arity;
+          if (copying && openHashes.size()){
+            openHashes.back() = (openHashes.back() ^ (uint8_t)src[p]) * 1099511628211ull;
+          }
+          if (op == OP_POP && openSubtrees.size()){
+            subtree_task task = openSubtrees.back();
+            openSubtrees.pop_back();
+            task.end = p + 1;
+            task.vertexEnd = vertices;
+            task.indexEnd = indices;
+            task.segmentEnd = segments;
+            task.paramEnd = parameters;
+            if (p + 1 - task.begin >= PARALLEL_MIN_SUBTREE){
+              subtreeTasks.push_back(task);
+            }
+            if (copying){
+              // a closed subtree is one symbol of its parent's hash
+              uint64_t hash = openHashes.back();
+              openHashes.pop_back();
+              if (openHashes.size()) openHashes.back() = (openHashes.back() ^ hash) * 1099511628211ull;
+              if (p + 1 - task.begin >= COPY_MIN_SYMBOLS){
+                copy_task candidate = { task, hash, 0 };
+                copyTasks.push_back(candidate);
+              }
+            }
+          }
+        }
+        openHashes.resize(0);
+        std::sort(subtreeTasks.begin(), subtreeTasks.end(), [](const subtree_task &a, const subtree_task &b){ return a.begin < b.begin; });
+        if (copying) groupCopies();
+      }
+
+      segmentFrames.resize(segments);
+      numSegments = segments;
+    }
+
+    /// sorts the copying candidates by their opening bracket and points each at the first one with the same hash and length
+    /// equal hashes are only a hint, the symbols are compared before anything is copied
+    void groupCopies(){
+      std::sort(copyTasks.begin(), copyTasks.end(), [](const copy_task &a, const copy_task &b){ return a.range.begin < b.range.begin; });
+
+      int count = copyTasks.size();
+      dynarray<int> order;
+      order.resize(count);
+      for (int i = 0; i != count; ++i){
+        order[i] = i;
+      }
+      const copy_task *tasks = copyTasks.data();
+      std::sort(order.begin(), order.end(), [tasks](int a, int b){
+        const copy_task &x = tasks[a], &y = tasks[b];
+        if (x.hash != y.hash) return x.hash < y.hash;
+        int xs = x.range.end - x.range.begin, ys = y.range.end - y.range.begin;
+        return xs != ys ? xs < ys : a < b;
+      });
+
+      for (int i = 0, first = 0; i != count; ++i){
+        const copy_task &x = tasks[order[i]], &y = tasks[order[first]];
+        if (x.hash != y.hash || x.range.end - x.range.begin != y.range.end - y.range.begin) first = i;
+        copyTasks[order[i]].group = order[first];
+      }
+    }
+
+    /// adds one symbol's geometry to the counts, sharing rings exactly as the interpreter does
+    void count_symbol(char c, int &segments, int &vertices, int &indices){
+      switch (symbols[(uint8_t)c].op){
+      case OP_DRAW:
+        ++segments;
+        vertices += countStack.back() ? sides : 2 * sides;
+        indices += 6 * sides;
+        countStack.back() = 1;
+        break;
+      case OP_PUSH:
+        countStack.push_back(countStack.back());
+        if ((int)countStack.size() - 1 > maxBracketDepth) maxBracketDepth = countStack.size() - 1;
+        break;
+      case OP_POP:
+        ++segments;
+        vertices += sides + 1;
+        indices += 3 * sides;
+        if (countStack.size() > 1) countStack.pop_back();
+        break;
+      default:
+        break;
+      }
+    }
+
+    /// reinterprets the axiom into the existing buffers after a turtle parameter change
+    void regenerate(){
+      initialiseDrawParams();
+      interpret_axiom();
+    }
+
+    /// returns the turtle parameters in use
+    turtle_params currentParams() const{
+      turtle_params params = { angle, translateF, radius, sides, isStochastic };
+      return params;
+    }
+
+    /// makes the given parameters current, anything but the radius moves the turtle and so invalidates the frames
+    void applyParams(const turtle_params &params){
+      if (params.sides != sides){
+        sides = params.sides;
+        buildRingTable();
+        countsDirty = true;
+        indicesValid = framesValid = false;
+      }
+      if (params.angle != angle || params.stochastic != isStochastic || params.translate[0] != translateF[0] ||
+        params.translate[1] != translateF[1] || params.translate[2] != translateF[2]){
+        framesValid = false;
+      }
+      angle = params.angle;
+      translateF = params.translate;
+      radius = params.radius;
+      isStochastic = params.stochastic;
+    }
+
+    /// rebuilds the builder after a parameter change, the radius alone does not move the turtle so the frames are enough
+    /// returns false if the build was cancelled
+    bool rebuildBuilder(){
+      if (framesValid && !countsDirty){
+        write_segment_batch(segmentFrames.data(), numSegments, builder.vertices.data());
+        return true;
+      }
+      initialiseDrawParams();
+      interpret_into(builder.vertices.data(), builder.indices.data());
+      return !isCancelled;
+    }
+
+    /// changes the turtle parameters through edit, the mesh is rebuilt now or by the worker when asynchronous
+    /// requests made while the worker is busy are merged into the one it picks up next
+    template <class edit_t> void editParams(edit_t edit){
+      dropCachedMeshes();
+      dropDetailLevels();
+      meshCurrent = false;
+      if (!isAsync){
+        turtle_params params = currentParams();
+        edit(params);
+        applyParams(params);
+        rebuildBuilder();
+        uploadGeometry();
+        return;
+      }
+
+      std::lock_guard<std::mutex> guard(workerLock);
+      edit(pending);
+      ++requestVersion;
+      workerWake.notify_all();
+    }
+
+    /// true once the build in flight should stop, checked every few thousand symbols by the interpreters
+    /// a superseded build is only dropped while the mesh on screen is younger than a build takes, so held keys still show progress
+    bool buildCancelled(){
+      if (!isBuilding) return false;
+      if (isCancelled) return true;
+      if (requestVersion == buildingVersion || clock::now() - lastPublish > lastBuildTime) return false;
+      isCancelled = true;
+      return true;
+    }
+
+    /// builds the latest request whenever there is one and the last result has been picked up
+    void workerLoop(){
+      std::unique_lock<std::mutex> guard(workerLock);
+      for (;;){
+        workerWake.wait(guard, [&]{ return isStopping || (!pauseDepth && !isReady && (requestVersion != builtVersion || (isDetailWanted && detailVersion < 0))); });
+        if (isStopping) return;
+
+        if (requestVersion == builtVersion){
+          // the mesh on screen is current, so the detail levels are built from it
+          isDetailWanted = false;
+          buildingVersion = requestVersion;
+          isBuilding = true;
+          isCancelled = false;
+          vec3 size = boundsMax - boundsMin;
+          guard.unlock();
+
+          bool finished = buildDetailBuilders(size);
+
+          guard.lock();
+          isBuilding = false;
+          if (finished) detailVersion = buildingVersion;
+          workerWake.notify_all();
+          continue;
+        }
+
+        turtle_params params = pending;
+        buildingVersion = requestVersion;
+        isBuilding = true;
+        isCancelled = false;
+        guard.unlock();
+
+        clock::time_point start = clock::now();
+        applyParams(params);
+        bool finished = rebuildBuilder();
+        clock::time_point end = clock::now();
+
+        guard.lock();
+        isBuilding = false;
+        if (finished){
+          builtVersion = buildingVersion;
+          isReady = true;
+          lastPublish = end;
+          lastBuildTime = end - start;
+        }
+        workerWake.notify_all();
+      }
+    }
+
+    /// waits for the build in flight to stop and holds the worker until resumeWorker()
+    /// the latest requested parameters are applied so the caller works on what the user asked for
+    void pauseWorker(){
+      if (!isAsync) return;
+      std::unique_lock<std::mutex> guard(workerLock);
+      if (pauseDepth++) return;
+      isCancelled = true;
+      workerWake.wait(guard, [&]{ return !isBuilding; });
+      isCancelled = false;
+      isReady = false;
+      detailVersion = -1;
+      applyParams(pending);
+    }
+
+    /// lets the worker pick up requests again, it rebuilds the mesh if the paused call left it out of date
+    void resumeWorker(){
+      if (!isAsync) return;
+      std::lock_guard<std::mutex> guard(workerLock);
+      if (--pauseDepth) return;
+      pending = currentParams();
+      builtVersion = meshCurrent ? (int)requestVersion : -1;
+      workerWake.notify_all();
+    }
+
+    /// joins the worker, a build in flight is abandoned
+    void stopWorker(){
+      if (!isAsync) return;
+      {
+        std::lock_guard<std::mutex> guard(workerLock);
+        isStopping = true;
+        isCancelled = true;
+        workerWake.notify_all();
+      }
+      worker.join();
+      isAsync = isStopping = isReady = isDetailWanted = false;
+      isCancelled = false;
+      pauseDepth = 0;
+      detailVersion = -1;
+    }
+
+    /// copies the current generation into the cache if the budget allows
+    void storeGeneration(){
+      storeGeneration(iteration_count, axiom->data(), axiom->size());
+    }
+
+    /// copies a generation's string into the cache if the budget allows
+    void storeGeneration(int generation, const char *text, unsigned size){
+      // the cache holds symbols alone, so a generation with parameters is derived again instead
+      if (isStreaming || isPacked || hasParameters || generation >= MAX_CACHED_GENERATIONS || generationCache[generation].size()) return;
+      if (cacheBytes + size > cacheBudget) return;
+
+      dynarray<char> &entry = generationCache[generation];
+      entry.resize(size);
+      memcpy(entry.data(), text, size);
+      cacheBytes += size;
+    }
+
+    /// returns the bytes used by a mesh
+    static size_t meshBytes(int vertices, int indices){
+      return vertices * sizeof(myVertex) + indices * sizeof(uint32_t);
+    }
+
+    /// hands the finished mesh of the current generation to the cache and starts a fresh one
+    void stashMesh(){
+      if (!isCachingGeometry || iteration_count >= MAX_CACHED_GENERATIONS || !meshCurrent) return;
+      cached_mesh &entry = meshCache[iteration_count];
+      if (entry.geometry || cacheBytes + meshBytes(numVertices, numIndices) > cacheBudget) return;
+
+      entry.geometry = _mesh;
+      entry.vertices = numVertices;
+      entry.indices = numIndices;
+      entry.boundsMin = boundsMin;
+      entry.boundsMax = boundsMax;
+      cacheBytes += meshBytes(numVertices, numIndices);
+      _mesh = new mesh();
+      numVertices = numIndices = vertexCapacity = indexCapacity = -1;
+      meshCurrent = false;
+    }
+
+    /// swaps in the cached mesh of the current generation, returns false if there is none
+    /// the builder is left to be recounted, it is only needed again if a parameter changes
+    bool restoreMesh(){
+      if (iteration_count >= MAX_CACHED_GENERATIONS || !meshCache[iteration_count].geometry) return false;
+
+      cached_mesh &entry = meshCache[iteration_count];
+      _mesh = entry.geometry;
+      entry.geometry = 0;
+      numVertices = vertexCapacity = entry.vertices;
+      numIndices = indexCapacity = entry.indices;
+      boundsMin = entry.boundsMin;
+      boundsMax = entry.boundsMax;
+      cacheBytes -= meshBytes(numVertices, numIndices);
+      meshCurrent = true;
+      return true;
+    }
+
+    /// drops the cached meshes, they were built with the old turtle parameters
+    void dropCachedMeshes(){
+      for (int g = 0; g != MAX_CACHED_GENERATIONS; ++g){
+        if (meshCache[g].geometry){
+          cacheBytes -= meshBytes(meshCache[g].vertices, meshCache[g].indices);
+          meshCache[g].geometry = 0;
+        }
+      }
+    }
+
+    /// empties the generation cache, needed whenever the rules change
+    void clearGenerationCache(){
+      dropCachedMeshes();
+      for (int g = 0; g != MAX_CACHED_GENERATIONS; ++g){
+        generationCache[g].reset();
+      }
+      cacheBytes = 0;
+    }
+
+    /// stops drawing the detail levels, they show the old tree until they are built again into the same trees and meshes
+    void dropDetailLevels(){
+      numDetailLevels = 0;
+    }
+
+    /// marks the current generation as changed so the next initialiseDrawParams() recounts it
+    void invalidateCounts(){
+      countsDirty = true;
+      indicesValid = framesValid = false;
+      meshCurrent = false;
+      detailDerived = false;
+      dropDetailLevels();
+    }
+
+    /// builds the coarser levels of the current tree into their trees' builders, size being the full tree's box
+    /// the level trees are derived again only when the grammar or generation changed, otherwise an edit just rebuilds them
+    /// returns false if the worker was asked to stop or a newer request made the levels stale
+    bool buildDetailBuilders(const vec3 &size){
+      turtle_params params = currentParams();
+      int count = wantedDetailLevels;
+      for (int k = 1; k < count; ++k){
+        if (isCancelled || (isBuilding && requestVersion != buildingVersion)) return false;
+
+        L_system *level = detailTrees[k];
+        if (!level || !detailDerived){
+          if (!level){
+            detailTrees[k] = level = new L_system();
+            level->setThreadPool(threadPool);
+          }
+          level->copyGrammar(*this);
+          // a shallower derivation is a smaller tree, so its segments are lengthened to match
+          int generation = iteration_count - k > 1 ? iteration_count - k : (iteration_count < 1 ? iteration_count : 1);
+          level->deriveFrom(*this, generation);
+        }
+
+        turtle_params p = params;
+        p.sides = sides - k > 2 ? sides - k : 2;
+        level->applyParams(p);
+        level->rebuildBuilder();
+        vec3 lo, hi;
+        measureBounds(level->builder.vertices.data(), level->builder.numVertices, lo, hi);
+        float levelSize = (hi - lo).length();
+        if (levelSize > 0 && fabsf(size.length() / levelSize - 1) > 0.01f){
+          p.translate = p.translate * (size.length() / levelSize);
+          level->applyParams(p);
+          level->rebuildBuilder();
+        }
+      }
+      detailDerived = true;
+      builtDetailLevels = count;
+      return true;
+    }
+
+    /// uploads the level trees' builders into their meshes, which only grow when a level no longer fits
+    void uploadDetailLevels(){
+      for (int k = 1; k < builtDetailLevels; ++k){
+        detailTrees[k]->uploadGeometry();
+      }
+      numDetailLevels = builtDetailLevels;
+    }
+
+    /// ----------------------------------------------------------------------------
+
+    /// maps the file and parses it in one pass into parser, returns false if the file is missing or has an error
+    bool parseFile(string name){
+      LS_PROFILE_PHASE(profile, L_system_profile::PHASE_PARSE, 0);
+      mapped_file file;
+      bool parsed;
+      if (file.open(name)){
+        fileSize = (int)file.size();
+        parsed = parser.parse(name, file.data(), file.size());
+      }
+      else{
+        // not a plain file, let octet find it
+        lSystemFile.resize(0);
+        app_utils::get_url(lSystemFile, name);
+        if (!lSystemFile.size()){
+          printf("%s: could not read the file\n", name.c_str());
+          return false;
+        }
+        fileSize = lSystemFile.size();
+        parsed = parser.parse(name, (const char *)lSystemFile.data(), lSystemFile.size());
+      }
+
+      if (!parsed){
+        printf("%s\n", parser.getError());
+        return false;
+      }
+      if (!isQuiet) printf("The file has been read\n");
+      return true;
+    }
+
+  public:
+
+    /// sizes a mesh's GL buffers for myVertex triangles
+    static void allocateMesh(mesh *target, int vertexCount, int indexCount){
+      allocateMesh(target, vertexCount, indexCount, vertexCount, indexCount);
+    }
+
+    /// sizes a mesh's GL buffers to hold the capacities and draw the counts, which may be fewer
+    static void allocateMesh(mesh *target, int vertexCount, int indexCount, int vertexCapacity, int indexCapacity){
+      target->init();
+
+      // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+      // allocate vertices and indices into OpenGL buffers
+      target->allocate(sizeof(myVertex) * vertexCapacity, sizeof(uint32_t) * indexCapacity);
+      target->set_params(sizeof(myVertex), indexCount, vertexCount, GL_TRIANGLES, GL_UNSIGNED_INT);
+
+      // describe the structure of my_vertex to OpenGL
+      target->add_attribute(attribute_pos, 3, GL_FLOAT, 0);
+      target->add_attribute(attribute_color, 4, GL_UNSIGNED_BYTE, 12, GL_TRUE);
+    }
+
+    /// copies geometry into a mesh allocated for exactly that much
+    static void copyToMesh(mesh *target, const myVertex *vertices, const uint32_t *indices, int vertexCount, int indexCount){
+      // the write-only locks map each buffer just for its copy
+      {
+        gl_resource::wolock vl(target->get_vertices());
+        memcpy(vl.u8(), vertices, sizeof(myVertex) * vertexCount);
+      }
+      {
+        gl_resource::wolock il(target->get_indices());
+        memcpy(il.u32(), indices, sizeof(uint32_t) * indexCount);
+      }
+    }
+
+    /// Parser function, maps the file and reads it in one pass
+    /// returns false and keeps the current grammar if the file is missing or has an error
+    bool loadFile(string name){
+      worker_pause pause(this);
+      if (!parseFile(name)) return false;
+
+      clearGenerationCache();
+      applyGrammar(parser);
+      storeGeneration();
+      fileName = name;
+      isWatching = fileStamp.read(name.c_str());
+      fileAngle = angle;
+      return true;
+    }
+
+    /// parses the loaded grammar again and rebuilds the tree at the same generation with the same turtle parameters and seed
+    /// when only plain rules changed, just what they reach is derived again, see rederive()
+    /// the angle follows the file only if the file's angle was edited, so an angle tuned with the keys survives
+    /// returns false and keeps the current tree if the file is missing or has an error
+    bool reloadFile(){
+      worker_pause pause(this);
+      if (!parseFile(fileName)) return false;
+
+      // the tree as it was, to reuse what the edit leaves alone
+      bool plain = !hasProductions && !hasAlternatives && !hasParameters && !isPacked && !isStreaming;
+      char previousAxiom = startingAxiom;
+      symbol_entry previousSymbols[256];
+      memcpy(previousSymbols, symbols, sizeof(symbols));
+      dynarray<char> previousPool, previous;
+      copyArray(previousPool, successorPool);
+      if (plain) copyArray(previous, *axiom);
+      int generation = iteration_count;
+      turtle_params params = currentParams();
+      float previousFileAngle = fileAngle;
+
+      clearGenerationCache();
+      applyGrammar(parser);
+      fileAngle = angle;
+      if (fileAngle != previousFileAngle) params.angle = fileAngle;
+      applyParams(params);
+
+      plain = plain && !hasProductions && !hasAlternatives && !hasParameters && !isPacked && !isStreaming;
+      if (!plain || !rederive(previous, previousSymbols, previousPool, generation, previousAxiom)){
+        iteration(generation);
+      }
+      storeGeneration();
+      regenerate();
+      if (!isQuiet) printf("%s has been reloaded\n", fileName.c_str());
+      return true;
+    }
+
+    /// loads a scratch copy of the grammar file, edits its last rule and reloads it at the given generation
+    /// the tree must then be what a fresh tree loading the edited file derives and builds, string and geometry byte for byte
+    /// returns false if it is not, the tree is left on the edited scratch file
+    bool testReload(const char *scratchPath, int generation){
+      worker_pause pause(this);
+      dynarray<char> text;
+      {
+        mapped_file file;
+        if (!file.open(fileName)){
+          printf("could not read %s\n", fileName.c_str());
+          return false;
+        }
+        text.resize((unsigned)file.size() + 1);
+        memcpy(text.data(), file.data(), file.size());
+        text[text.size() - 1] = 0;
+      }
+
+      // the last rule gets its own symbol again at the end of its successor, so the rules that reach it keep theirs
+      const char *rules = strstr(text.data(), "Rules:");
+      int count = rules ? atoi(rules + 6) : 0;
+      const char *line = 0, *end = count > 0 ? strchr(rules, ';') : 0;
+      for (int k = 0; k != count && end; ++k){
+        line = end + 1;
+        end = strchr(line, ';');
+      }
+      if (!end){
+        printf("no rule to edit, skipped\n");
+        return true;
+      }
+      while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n') ++line;
+      unsigned size = text.size() - 1, at = (unsigned)(end - text.data());
+      dynarray<char> edited;
+      edited.resize(size + 1);
+      memcpy(edited.data(), text.data(), at);
+      edited[at] = *line;
+      memcpy(edited.data() + at + 1, text.data() + at, size - at);
+
+      auto save = [&](const char *data, unsigned bytes){
+        FILE *file = fopen(scratchPath, "wb");
+        bool written = file && fwrite(data, 1, bytes, file) == bytes;
+        if (file) fclose(file);
+        return written;
+      };
+      string original = fileName;
+      if (!save(text.data(), size) || !loadFile(scratchPath)){
+        printf("could not load a copy of %s\n", original.c_str());
+        return false;
+      }
+      deriveGeneration(generation);
+      bool plain = !hasProductions && !hasAlternatives && !hasParameters && !isPacked && !isStreaming;
+      if (!save(edited.data(), size + 1)) return false;
+      if (!reloadFile()){
+        printf("the edited grammar does not parse, skipped\n");
+        return true;
+      }
+
+      ref<L_system> fresh = new L_system();
+      fresh->setQuiet(true);
+      fresh->setThreadCount(threadCount);
+      if (!fresh->loadFile(scratchPath)) return false;
+      fresh->deriveGeneration(generation);
+      bool same = !isPacked && !isStreaming ? axiom->size() == fresh->axiom->size() &&
+        !memcmp(axiom->data(), fresh->axiom->data(), axiom->size()) : getAxiomSize() == fresh->getAxiomSize();
+
+      dynarray<myVertex> vertices, freshVertices;
+      dynarray<uint32_t> indices, freshIndices;
+      buildGeometry(vertices, indices);
+      fresh->buildGeometry(freshVertices, freshIndices);
+      same = same && vertices.size() == freshVertices.size() && indices.size() == freshIndices.size() &&
+        !memcmp(vertices.data(), freshVertices.data(), sizeof(myVertex) * vertices.size()) &&
+        !memcmp(indices.data(), freshIndices.data(), sizeof(uint32_t) * indices.size());
+      printf("generation %d: %d symbols, %s%s\n", iteration_count, getAxiomSize(), plain ? "re-derived" : "derived again",
+        same ? "" : " MISMATCH");
+      return same;
+    }
+
+    /// reloads the grammar if its file has been saved since it was loaded, looking at the file at most every RELOAD_POLL_MS
+    /// returns true if the tree was rebuilt, a file that does not parse is left until it is saved again
+    bool reloadIfChanged(){
+      if (!isWatching) return false;
+      clock::time_point now = clock::now();
+      if (now - lastPoll < std::chrono::milliseconds(RELOAD_POLL_MS)) return false;
+      lastPoll = now;
+
+      file_stamp stamp;
+      if (!stamp.read(fileName.c_str()) || stamp == fileStamp) return false;
+      fileStamp = stamp;
+      return reloadFile();
+    }
+
+    /// loads another grammar into this tree as if it were a new one, with the default turtle parameters and seed
+    /// the node, meshes and every buffer are kept, so switching trees allocates little and the GL buffers only grow
+    /// returns false and keeps the current tree if the file is missing or has an error
+    bool switchFile(string name){
+      worker_pause pause(this);
+      turtle_params params = { angle, vec3(0, 1.0f, 0), 0.2f, 3, false };
+      if (!loadFile(name)) return false;
+      params.angle = angle;
+      applyParams(params);
+      seed = 1;
+      return true;
+    }
+
+    /// This function iterates the axiom the number of times given, stopping early if a generation would be too long
+    void iteration(int numb){
+      worker_pause pause(this);
+      for (int i = 0; i < numb; ++i){
+        if (!iterate()) break;
+      }
+    }
+
+    /// derives the given generation without building the mesh, starting again from the axiom if it is below the current one
+    void deriveGeneration(int target){
+      worker_pause pause(this);
+      if (target < iteration_count) resetAxiom();
+      iteration(target - iteration_count);
+    }
+
+    /// derives and builds the generation serially and then streamed, packed and on threads, each deterministic and stochastic
+    /// returns false if any of them does not make the serial string and geometry byte for byte, a streamed tree has no
+    /// string so only its geometry is compared. the tree is left at generation with its modes as they were
+    bool testModes(int generation){
+      worker_pause pause(this);
+      struct mode{
+        const char *name;
+        bool streaming, packed;
+        int threads;
+      };
+      static const mode modes[] = {
+        { "serial", false, false, 1 },
+        { "parallel", false, false, 4 },
+        { "streaming", true, false, 1 },
+        { "packed", false, true, 1 },
+        { "packed on threads", false, true, 4 },
+      };
+
+      bool wasStochastic = isStochastic, wasStreaming = isStreaming, wasPacked = isPacked;
+      int wasThreads = threadCount;
+      bool ok = true;
+      dynarray<char> reference, text;
+      dynarray<myVertex> refVertices, vertices;
+      dynarray<uint32_t> refIndices, indices;
+      for (int stochastic = 0; stochastic != 2; ++stochastic){
+        setStochastic(stochastic != 0);
+        for (unsigned m = 0; m != sizeof(modes) / sizeof(modes[0]); ++m){
+          setStreaming(modes[m].streaming);
+          if (isStreaming != modes[m].streaming || setPacked(modes[m].packed) != modes[m].packed){
+            printf("%s %s: not possible with this grammar, skipped\n", stochastic ? "stochastic" : "deterministic", modes[m].name);
+            continue;
+          }
+          setThreadCount(modes[m].threads);
+          deriveGeneration(0);
+          deriveGeneration(generation);
+
+          dynarray<char> &chars = m ? text : reference;
+          chars.resize(0);
+          if (isPacked) unpackInto(chars);
+          else if (!isStreaming) copyArray(chars, *axiom);
+          dynarray<myVertex> &v = m ? vertices : refVertices;
+          dynarray<uint32_t> &i = m ? indices : refIndices;
+          buildGeometry(v, i);
+          if (!m) continue;
+
+          bool same = (isStreaming || (text.size() == reference.size() && !memcmp(text.data(), reference.data(), text.size()))) &&
+            vertices.size() == refVertices.size() && indices.size() == refIndices.size() &&
+            !memcmp(vertices.data(), refVertices.data(), sizeof(myVertex) * vertices.size()) &&
+            !memcmp(indices.data(), refIndices.data(), sizeof(uint32_t) * indices.size());
+          printf("%s %s: %d symbols, %u vertices%s\n", stochastic ? "stochastic" : "deterministic", modes[m].name,
+            getAxiomSize(), vertices.size(), same ? "" : " MISMATCH");
+          ok = ok && same;
+        }
+      }
 
-    // l System variables
-    int fileSize;
-    octet::string message;            // contains the message
-    dynarray<uint8_t> lSystemFile;    // containts the entire file
-    dynarray<char> alphabet;          // contains the alphabet
-    dynarray<char> axiom;             // contains the axiom
-    char startingAxiom;               // axiom from file
-    hash_map<char, string> rules;     // contains the rules
-    float angle;                      // angle used for rotation
-    int iteration_count;
+      setStochastic(wasStochastic);
+      setStreaming(wasStreaming);
+      setPacked(wasPacked);
+      setThreadCount(wasThreads);
+      return ok;
+    }
 
-    // drawing variables
-    ref<scene_node> node;
-    ref<mesh> _mesh;
-    myVertex *vtx;
-    int numVtxs;
-    uint32_t *idx;
-    dynarray<mat4t> placementStack;
-    vec3 translateF = vec3(0, 1.0f, 0);
-    float radius = 0.2f;
-    const int VERTSPERFACE = 3;
+    /// times the reference rewrite against iterate() for each generation up to maxDepth, leaves the tree at maxDepth
+    /// the reference is a char string, so packing is turned off, and it only knows plain rules, so other grammars are skipped
+    /// returns false if the two rewrites ever differ
+    bool benchmarkIteration(int maxDepth){
+      worker_pause pause(this);
+      typedef std::chrono::high_resolution_clock clock;
+      dynarray<char> reference;
+
+      if (hasAlternatives || hasProductions || isStreaming){
+        printf("the reference rewrite only knows plain rules, skipped\n");
+        return true;
+      }
+      setPacked(false);
+      resetAxiom();
+      bool ok = true;
+      printf("depth, symbols, reference ms, two pass ms, speedup\n");
+      for (int depth = 1; depth <= maxDepth; ++depth){
+        if (!fitsGeneration(countExpansion(axiom->data(), axiom->size(), 0))) break;
+        clock::time_point t0 = clock::now();
+        iterate_reference(*axiom, reference);
+        clock::time_point t1 = clock::now();
+        iterate();
+        clock::time_point t2 = clock::now();
+
+        double refMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double newMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        bool same = reference.size() == axiom->size() && !memcmp(reference.data(), axiom->data(), axiom->size());
+        printf("%i, %u, %.3f, %.3f, %.2fx%s\n", depth, axiom->size(), refMs, newMs, newMs > 0 ? refMs / newMs : 0.0,
+          same ? "" : " MISMATCH");
+        ok = ok && same;
+      }
+      return ok;
+    }
 
-    // random generation
-    random randNumGen;
-    bool isStochastic = false;
-    float varience = 0.05f;   // maximum percentage variation from original value 
-    int rand = 0;
-    vec3 brown = vec3(1, 0, 0.2f);
-    vec3 green = vec3(0, 0.8f, 1);
+    /// returns the key of a generation's cache file, a hash of the grammar, the generation and everything that shapes the mesh
+    uint64_t cacheKey(int generation){
+      L_system_cache_hash hash;
+      hash.add((uint32_t)L_system_cache_header::VERSION);
+      hash.add(startingAxiom);
+      for (int c = 0; c != 256; ++c){
+        hash.add(symbols[c].hasRule);
+        if (symbols[c].hasRule) hash.add(&successorPool[symbols[c].successor], symbols[c].length);
+        for (int k = 0; k != symbols[c].numAlternatives; ++k){
+          const rule_alternative &a = alternatives[symbols[c].firstAlternative + k];
+          hash.add(&successorPool[a.successor], a.length);
+          hash.add(a.threshold);
+        }
+      }
+      hash.add(generation);
+      hash.add(angle);
+      hash.add(translateF[0]);
+      hash.add(translateF[1]);
+      hash.add(translateF[2]);
+      hash.add(radius);
+      hash.add(sides);
+      hash.add(varience);
+      hash.add(brown[0]);
+      hash.add(brown[1]);
+      hash.add(brown[2]);
+      hash.add(green[0]);
+      hash.add(green[1]);
+      hash.add(green[2]);
+      hash.add(isStochastic);
+      if (isStochastic || hasAlternatives){
+        hash.add(seed);
+      }
+      if (hasProductions){
+        hash.add(productions.data(), sizeof(L_system_parser::production) * productions.size());
+        hash.add(productionPool.data(), productionPool.size());
+        hash.add(productionArguments.data(), sizeof(L_system_parser::expression) * productionArguments.size());
+        hash.add(expressionCode.data(), sizeof(L_system_parser::expression_op) * expressionCode.size());
+        hash.add(startingParams.data(), sizeof(float) * startingParams.size());
+      }
+      // 0 is never a valid key, see loadCache()
+      return hash.value ? hash.value : 1;
+    }
 
-    // this function converts three floats into a RGBA 8 bit color, taken from Andy's geometry example
-    static uint32_t make_color(float r, float g, float b) {
-      return 0xff000000 + ((int)(r*255.0f) << 0) + ((int)(g*255.0f) << 8) + ((int)(b*255.0f) << 16);
+    /// returns the file a generation is cached in, named by its key
+    string cachePath(const char *dir, int generation){
+      string path;
+      path.format("%s/%016llx.lsc", dir, (unsigned long long)cacheKey(generation));
+      return path;
     }
 
-    /// finds the location of a given char inside a dynarray from a starting position
-    int getPosition(dynarray<uint8_t> _array, char target, int startPos){
-      for (int i = startPos; i < _array.size(); i++){
-        if (_array[i] == target)
-          return i;
+    /// writes the rules, every kept generation's string and the current mesh to a cache file
+    /// returns false for a grammar with productions, as the file format has no place for them or their parameters
+    bool saveCache(const char *path){
+      worker_pause pause(this);
+      // the loader only takes generations the generation cache can hold
+      if (hasProductions || iteration_count >= MAX_CACHED_GENERATIONS) return false;
+      if (countsDirty || !indicesValid || !framesValid){
+        initialiseDrawParams();
+        interpret_into(builder.vertices.data(), builder.indices.data());
       }
-      return -1;
+
+      FILE *file = fopen(path, "wb");
+      if (!file) return false;
+
+      L_system_cache_header header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, "LSYC", 4);
+      header.version = L_system_cache_header::VERSION;
+      header.key = cacheKey(iteration_count);
+      header.vertexSize = sizeof(myVertex);
+      header.symbolEntrySize = sizeof(symbol_entry);
+      header.generation = iteration_count;
+      header.startingAxiom = (uint8_t)startingAxiom;
+      header.angle = angle;
+      header.translate[0] = translateF[0];
+      header.translate[1] = translateF[1];
+      header.translate[2] = translateF[2];
+      header.radius = radius;
+      header.sides = sides;
+      header.stochastic = isStochastic;
+      header.seed = seed;
+      header.poolSize = successorPool.size();
+      header.numAlternatives = alternatives.size();
+      header.numStrings = iteration_count + 1;
+      header.numVertices = builder.numVertices;
+      header.numIndices = builder.numIndices;
+
+      // each section is padded to the alignment and its offset returned
+      uint64_t pos = 0;
+      bool ok = true;
+      auto put = [&](const void *data, size_t size) -> uint64_t {
+        static const char zeros[L_system_cache_header::ALIGNMENT] = {};
+        size_t pad = (size_t)(-(int64_t)pos & (L_system_cache_header::ALIGNMENT - 1));
+        ok = ok && fwrite(zeros, 1, pad, file) == pad && (!size || fwrite(data, 1, size, file) == size);
+        pos += pad;
+        uint64_t offset = pos;
+        pos += size;
+        return offset;
+      };
+
+      put(&header, sizeof(header));
+      header.symbolsOffset = put(symbols, sizeof(symbols));
+      header.poolOffset = put(successorPool.data(), successorPool.size());
+      header.alternativesOffset = put(alternatives.data(), sizeof(rule_alternative) * alternatives.size());
+
+      // the current generation comes from the axiom, the others from the generation cache
+      // the file holds chars, so a packed generation is unpacked for it
+      dynarray<char> unpacked;
+      if (isPacked) unpackInto(unpacked);
+      const dynarray<char> *current = isPacked ? &unpacked : axiom;
+      dynarray<L_system_cache_string> table;
+      table.resize(header.numStrings);
+      for (unsigned g = 0; g != header.numStrings; ++g){
+        table[g].offset = table[g].size = 0;
+      }
+      header.stringsOffset = put(table.data(), sizeof(L_system_cache_string) * table.size());
+      for (unsigned g = 0; g != header.numStrings; ++g){
+        const dynarray<char> *text = (int)g == iteration_count && !isStreaming ? current :
+          g < MAX_CACHED_GENERATIONS && generationCache[g].size() ? &generationCache[g] : 0;
+        if (text){
+          table[g].size = text->size();
+          table[g].offset = put(text->data(), text->size());
+        }
+      }
+
+      header.verticesOffset = put(builder.vertices.data(), sizeof(myVertex) * builder.numVertices);
+      header.indicesOffset = put(builder.indices.data(), sizeof(uint32_t) * builder.numIndices);
+      header.fileSize = pos;
+
+      // go back and fill in the offsets
+      ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+      ok = ok && fseek(file, (long)header.stringsOffset, SEEK_SET) == 0 &&
+        fwrite(table.data(), sizeof(L_system_cache_string), table.size(), file) == table.size();
+      ok = fclose(file) == 0 && ok;
+      if (!ok) remove(path);
+      return ok;
+    }
+
+    /// true if every section of a cache file is aligned as saveCache() writes them
+    static bool alignedCache(const L_system_cache_header &header){
+      uint64_t offsets = header.symbolsOffset | header.poolOffset | header.alternativesOffset | header.stringsOffset |
+        header.verticesOffset | header.indicesOffset;
+      return !(offsets & (L_system_cache_header::ALIGNMENT - 1));
     }
 
-    /// removes whitespace from a dynarray of chars, uses memcpy
-    void removeWhiteSpace(dynarray<uint8_t> &_array){
-      dynarray<char> rtn;
-      for (int i = 0; i < _array.size(); i++){
-        if (_array[i] != ' ' && _array[i] != '\n' && _array[i] != '\r' && _array[i] != '\t'){
-          rtn.push_back(_array[i]);
+    /// true if the rules and mesh of a cache file whose sections are inside it can be used as they are
+    /// every successor must be in the pool, each weighted rule must end with a certain choice, each turn
+    /// must be one of turns[] and each index must be one of the file's vertices
+    static bool validCache(const char *base, const L_system_cache_header &header){
+      if (header.startingAxiom > 255 || header.numIndices % 3) return false;
+
+      const symbol_entry *entries = (const symbol_entry *)(base + header.symbolsOffset);
+      const rule_alternative *alternatives = (const rule_alternative *)(base + header.alternativesOffset);
+      for (int c = 0; c != 256; ++c){
+        const symbol_entry &e = entries[c];
+        if ((uint64_t)e.successor + e.length > header.poolSize || e.op > OP_TURN || e.turn >= sizeof(turns) / sizeof(turns[0]) ||
+          e.numProductions || e.arity || (uint64_t)e.firstAlternative + e.numAlternatives > header.numAlternatives){
+          return false;
         }
+        uint64_t threshold = 0;
+        for (unsigned k = 0; k != e.numAlternatives; ++k){
+          const rule_alternative &a = alternatives[e.firstAlternative + k];
+          if ((uint64_t)a.successor + a.length > header.poolSize || a.threshold < threshold) return false;
+          threshold = a.threshold;
+        }
+        if (e.numAlternatives && threshold != 1ull << 32) return false;
       }
 
-      _array.resize(rtn.size());
-      memcpy(_array.data(), rtn.data(), rtn.size()*sizeof(uint8_t));
+      const uint32_t *indices = (const uint32_t *)(base + header.indicesOffset);
+      for (unsigned i = 0; i != header.numIndices; ++i){
+        if (indices[i] >= header.numVertices) return false;
+      }
+      return true;
     }
 
-    /// This function iterates once over an L-system
-    void iterate(){
-      dynarray<char> new_array;
-      string temp;
-      int location;
-      char c;
-      if (LS_DEBUG_ITERATE) printf("Iterate started\n");
+    /// loads a tree from a cache file, the mesh is uploaded straight from the mapped file with no derivation or interpretation
+    /// the file must have been saved with key, which is never 0, and everything in it is checked before it is used
+    /// returns false and changes nothing if the file is missing, stale or damaged
+    bool loadCache(const char *path, uint64_t key){
+      worker_pause pause(this);
+      mapped_file file;
+      if (!key || !file.open(path) || file.size() < sizeof(L_system_cache_header)) return false;
+
+      // the mapping is page aligned, so the header can be read where it is
+      const char *base = file.data();
+      L_system_cache_header header = *(const L_system_cache_header *)base;
+      if (memcmp(header.magic, "LSYC", 4) || header.version != L_system_cache_header::VERSION || header.fileSize != file.size() ||
+        header.key != key || header.vertexSize != sizeof(myVertex) || header.symbolEntrySize != sizeof(symbol_entry) ||
+        header.generation >= MAX_CACHED_GENERATIONS || (uint64_t)header.numStrings != (uint64_t)header.generation + 1 ||
+        header.sides < 3 || header.sides > MAX_SIDES || !alignedCache(header) ||
+        !header.contains(header.symbolsOffset, sizeof(symbols)) || !header.contains(header.poolOffset, header.poolSize) ||
+        !header.contains(header.alternativesOffset, (uint64_t)sizeof(rule_alternative) * header.numAlternatives) ||
+        !header.contains(header.stringsOffset, (uint64_t)sizeof(L_system_cache_string) * header.numStrings) ||
+        !header.contains(header.verticesOffset, (uint64_t)sizeof(myVertex) * header.numVertices) ||
+        !header.contains(header.indicesOffset, (uint64_t)sizeof(uint32_t) * header.numIndices) ||
+        !validCache(base, header)){
+        return false;
+      }
+
+      const L_system_cache_string *table = (const L_system_cache_string *)(base + header.stringsOffset);
+      for (unsigned g = 0; g != header.numStrings; ++g){
+        if (!header.contains(table[g].offset, table[g].size) || table[g].size > MAX_SYMBOLS) return false;
+      }
+      // without streaming the cached generation's string is needed to carry on from it
+      if (!isStreaming && !table[header.generation].size) return false;
+
+      // the rules
+      memcpy(symbols, base + header.symbolsOffset, sizeof(symbols));
+      successorPool.resize(header.poolSize);
+      memcpy(successorPool.data(), base + header.poolOffset, header.poolSize);
+      alternatives.resize(header.numAlternatives);
+      if (alternatives.size()) memcpy(alternatives.data(), base + header.alternativesOffset, sizeof(rule_alternative) * alternatives.size());
+      hasAlternatives = false;
+      for (int c = 0; c != 256; ++c){
+        if (symbols[c].numAlternatives) hasAlternatives = true;
+      }
+      weightedRules.resize(0);
+      weightedPool.resize(0);
+      productions.resize(0);
+      startingParams.resize(0);
+      hasProductions = hasContexts = hasParameters = false;
+      startingAxiom = (char)header.startingAxiom;
+
+      // the parameters
+      angle = header.angle;
+      translateF = vec3(header.translate[0], header.translate[1], header.translate[2]);
+      radius = header.radius;
+      isStochastic = header.stochastic != 0;
+      seed = header.seed;
+      if ((int)header.sides != sides){
+        sides = header.sides;
+        buildRingTable();
+      }
+
+      // the strings
+      clearGenerationCache();
+      if (isPacked && !compileCodes()) isPacked = false;
+      resetAxiom();
+      for (unsigned g = 0; g != header.numStrings; ++g){
+        if (table[g].size) storeGeneration(g, base + table[g].offset, (unsigned)table[g].size);
+      }
+      if (!isStreaming){
+        const L_system_cache_string &current = table[header.generation];
+        axiom->resize((unsigned)current.size);
+        memcpy(axiom->data(), base + current.offset, axiom->size());
+        if (isPacked) packAxiom();
+      }
+      iteration_count = header.generation;
+
+      // the mesh, the builder is left to be recounted if a parameter changes
+      invalidateCounts();
+      uploadBuffers((const myVertex *)(base + header.verticesOffset), (const uint32_t *)(base + header.indicesOffset),
+        header.numVertices, header.numIndices);
+      return true;
+    }
+
+    /// loads a generation from its cache file in dir, or derives and interprets it and writes the file for next time
+    /// dir is made if it is not there yet. returns true if the cache was used
+    bool loadOrBuild(const char *dir, int generation){
+      worker_pause pause(this);
+      string path = cachePath(dir, generation);
+      if (loadCache(path, cacheKey(generation))) return true;
+      setGeneration(generation);
+      if (L_system_cache_dir::make(dir)) saveCache(path);
+      return false;
+    }
+
+    /// saves the generation to a cache file in dir and loads it into a fresh tree, whose mesh must be this tree's byte for byte
+    /// then checks that the file is refused under another key, cut short or with a damaged header
+    /// returns false if any of these goes wrong, the tree is left at generation
+    bool testCache(const char *dir, int generation){
+      worker_pause pause(this);
+      struct damage{
+        const char *name;
+        void (*apply)(L_system_cache_header &header);
+      };
+      static const damage damages[] = {
+        { "generation past the string table", [](L_system_cache_header &h){ h.generation = 0xffffffff; h.numStrings = 0; } },
+        { "generation past the cache", [](L_system_cache_header &h){ h.generation = MAX_CACHED_GENERATIONS; h.numStrings = h.generation + 1; } },
+        { "too many sides", [](L_system_cache_header &h){ h.sides = 0x7fffffff; } },
+        { "too few sides", [](L_system_cache_header &h){ h.sides = 2; } },
+        { "vertices past the end", [](L_system_cache_header &h){ h.numVertices = 0xffffffff; } },
+        { "strings past the end", [](L_system_cache_header &h){ h.stringsOffset = h.fileSize; } },
+        { "unaligned indices", [](L_system_cache_header &h){ h.indicesOffset += 1; } },
+        { "version", [](L_system_cache_header &h){ h.version += 1; } },
+      };
+
+      if (hasProductions || generation >= MAX_CACHED_GENERATIONS){
+        printf("a cache file has no place for productions or generations past %d, skipped\n", MAX_CACHED_GENERATIONS - 1);
+        return true;
+      }
+      setGeneration(generation);
+      dynarray<myVertex> vertices;
+      dynarray<uint32_t> indices;
+      buildGeometry(vertices, indices);
+      uint64_t key = cacheKey(generation);
+      string path = cachePath(dir, generation);
+      if (!L_system_cache_dir::make(dir) || !saveCache(path)){
+        printf("could not write %s\n", path.c_str());
+        return false;
+      }
 
-      for each (char c in axiom){
-        if (rules.contains(c)){
-          temp = rules[c];
-          location = new_array.size();
-          new_array.resize(new_array.size() + temp.size());
-          memcpy(&new_array[location], temp.data(), temp.size());
+      // the round trip
+      ref<L_system> loaded = new L_system();
+      loaded->setQuiet(true);
+      bool same = loaded->loadCache(path, key) && loaded->numVertices == vertices.size() && loaded->numIndices == indices.size();
+      if (same){
+        gl_resource::rolock vl(loaded->_mesh->get_vertices());
+        gl_resource::rolock il(loaded->_mesh->get_indices());
+        same = !memcmp(vl.u8(), vertices.data(), sizeof(myVertex) * vertices.size()) &&
+          !memcmp(il.u32(), indices.data(), sizeof(uint32_t) * indices.size());
+      }
+      printf("generation %d: %u vertices, round trip%s\n", generation, vertices.size(), same ? "" : " MISMATCH");
+      bool ok = same;
+
+      // the file must be refused whatever is wrong with it
+      dynarray<char> bytes;
+      {
+        mapped_file file;
+        if (!file.open(path) || file.size() < sizeof(L_system_cache_header)) return false;
+        bytes.resize((unsigned)file.size());
+        memcpy(bytes.data(), file.data(), bytes.size());
+      }
+      string damagedPath;
+      damagedPath.format("%s/damaged.lsc", dir);
+      auto refused = [&](const char *name, const char *data, size_t size){
+        FILE *file = fopen(damagedPath, "wb");
+        bool written = file && fwrite(data, 1, size, file) == size;
+        if (file) fclose(file);
+        ref<L_system> other = new L_system();
+        other->setQuiet(true);
+        bool isRefused = written && !other->loadCache(damagedPath, key);
+        printf("%s: %s\n", name, isRefused ? "refused" : "LOADED");
+        return isRefused;
+      };
+      bool stale = loaded->loadCache(path, key ^ 1);
+      printf("stale key: %s\n", stale ? "LOADED" : "refused");
+      ok = !stale && ok;
+      ok = refused("truncated", bytes.data(), bytes.size() - 1) && ok;
+      ok = refused("header only", bytes.data(), sizeof(L_system_cache_header)) && ok;
+      for (unsigned i = 0; i != sizeof(damages) / sizeof(damages[0]); ++i){
+        dynarray<char> damaged;
+        damaged.resize(bytes.size());
+        memcpy(damaged.data(), bytes.data(), bytes.size());
+        L_system_cache_header header;
+        memcpy(&header, damaged.data(), sizeof(header));
+        damages[i].apply(header);
+        memcpy(damaged.data(), &header, sizeof(header));
+        ok = refused(damages[i].name, damaged.data(), damaged.size()) && ok;
+      }
+      remove(damagedPath);
+      return ok;
+    }
+
+    /// times the parser on machine generated grammars of up to maxRules rules, each rule ruleLength symbols long
+    /// the grammar is parsed from memory, so this is the tokenizer alone without the file system
+    /// returns false if a generated grammar does not parse
+    bool benchmarkParser(int maxRules, int ruleLength){
+      typedef std::chrono::high_resolution_clock clock;
+      static const char symbolSet[] = "FX+-<>^*[]ABCDEGHIJKLMNOPQRSTUVWYZ";
+      random rng(1);
+      L_system_parser parser;
+      dynarray<char> text;
+      bool allParsed = true;
+
+      printf("rules, bytes, ms, MB/s, rules/s\n");
+      for (int numRules = 16; numRules <= maxRules; numRules *= 4){
+        string header;
+        header.format("Message: generated grammar;\nAlphabet: F,X,+,-,<,>,^,*,[,],A,B,C;\nAxiom: X;\nRules: %d;\n", numRules);
+        text.resize(0);
+        for (int i = 0; i != header.size(); ++i) text.push_back(header[i]);
+        for (int r = 0; r != numRules; ++r){
+          text.push_back(symbolSet[r % (sizeof(symbolSet) - 1)]);
+          text.push_back(' ');
+          text.push_back('=');
+          text.push_back(' ');
+          for (int i = 0; i != ruleLength; ++i){
+            text.push_back(symbolSet[rng.get(0, (int)sizeof(symbolSet) - 1)]);
+            if (i % 64 == 63) text.push_back('\n');
+          }
+          text.push_back(';');
+          text.push_back('\n');
         }
-        else{
-          location = new_array.size();
-          new_array.resize(new_array.size() + 1);
-          memcpy(&new_array[location], &c, 1);
+        static const char footer[] = "Angle: 25.7;\nIterations: 5;\n";
+        for (int i = 0; footer[i]; ++i) text.push_back(footer[i]);
+
+        // repeat small grammars so the timer has something to measure
+        int repeats = 1 + (1 << 20) / text.size();
+        clock::time_point t0 = clock::now();
+        bool ok = true;
+        for (int i = 0; i != repeats; ++i){
+          ok = parser.parse("generated", text.data(), text.size()) && ok;
+        }
+        double seconds = std::chrono::duration<double>(clock::now() - t0).count() / repeats;
+        printf("%d, %u, %.3f, %.1f, %.0f%s\n", numRules, text.size(), seconds * 1000, seconds > 0 ? text.size() / seconds / (1024 * 1024) : 0.0,
+          seconds > 0 ? numRules / seconds : 0.0, ok ? "" : " FAILED");
+        if (!ok) printf("%s\n", parser.getError());
+        allParsed = allParsed && ok;
+      }
+      return allParsed;
+    }
+
+    /// builds the current generation's geometry into plain buffers without touching the mesh or OpenGL
+    void buildGeometry(dynarray<myVertex> &vertices, dynarray<uint32_t> &indices){
+      worker_pause pause(this);
+      int numVerts = 0, numIdxs = 0;
+      countsDirty = true;
+      indicesValid = framesValid = false;
+      countGeometry(numVerts, numIdxs);
+      vertices.resize(numVerts);
+      indices.resize(numIdxs);
+      interpret_into(vertices.data(), indices.data());
+      // the builder's counts and frames were overwritten, the mesh itself is untouched
+      countsDirty = true;
+      indicesValid = framesValid = false;
+    }
+
+    /// changes the turtle parameters through edit and rebuilds the builder the way a key press does, without uploading it
+    /// for timing a tweak headless, returns the vertices built
+    template <class edit_t> int rebuildEdited(edit_t edit){
+      worker_pause pause(this);
+      dropCachedMeshes();
+      dropDetailLevels();
+      meshCurrent = false;
+      turtle_params params = currentParams();
+      edit(params);
+      applyParams(params);
+      rebuildBuilder();
+      return builder.numVertices;
+    }
+
+    /// turns the stochastic mode on or off without rebuilding the mesh
+    void setStochastic(bool stochastic){
+      worker_pause pause(this);
+      isStochastic = stochastic;
+    }
+
+    /// sets the seed of the stochastic mode without rebuilding the mesh
+    /// the weighted rules choose by the seed as well, so a grammar with them is derived again to the same generation
+    void setSeed(unsigned value){
+      worker_pause pause(this);
+      if (value == seed) return;
+      seed = value;
+      detailDerived = false;
+      if (hasAlternatives){
+        int generation = iteration_count;
+        clearGenerationCache();
+        resetAxiom();
+        storeGeneration();
+        iteration(generation);
+      }
+    }
+
+    /// returns true if the grammar has weighted rules, whose choices depend on the seed
+    bool hasStochasticRules() const{
+      return hasAlternatives;
+    }
+
+    /// checks that the weighted rules choose their successors in proportion to their weights
+    /// draws samples choices for each symbol with weighted rules over many generations and positions,
+    /// prints the expected and observed frequencies and returns false if a chi squared test rejects them at the 0.1% level
+    bool testRuleDistribution(int samples){
+      bool ok = true;
+      dynarray<int> counts;
+      printf("symbol, successor, expected, observed\n");
+      for (int c = 0; c != 256; ++c){
+        const symbol_entry &e = symbols[c];
+        if (!e.numAlternatives) continue;
+        counts.resize(e.numAlternatives);
+        for (int k = 0; k != counts.size(); ++k){
+          counts[k] = 0;
+        }
+        for (int i = 0; i != samples; ++i){
+          const rule_alternative &a = chooseAlternative(e, i & 15, (uint64_t)i >> 4);
+          counts[(int)(&a - &alternatives[e.firstAlternative])]++;
         }
 
-        if (LS_DEBUG_ITERATE){
-          printf("temp: %s\n", temp);
-          printf("Here is the current string: %.*s\n", new_array.size(), new_array.data());
+        double chiSquared = 0;
+        uint64_t previous = 0;
+        for (int k = 0; k != counts.size(); ++k){
+          const rule_alternative &a = alternatives[e.firstAlternative + k];
+          double p = (double)(a.threshold - previous) / 4294967296.0;
+          double expected = p * samples;
+          previous = a.threshold;
+          chiSquared += expected > 0 ? (counts[k] - expected) * (counts[k] - expected) / expected : 0;
+          printf("%c, %.*s, %.4f, %.4f\n", (char)c, a.length, &successorPool[a.successor], p, (double)counts[k] / samples);
         }
+
+        // Wilson and Hilferty's approximation of the 99.9th percentile of chi squared
+        double dof = counts.size() - 1, z = 3.0902;
+        double h = 1 - 2 / (9 * dof) + z * sqrt(2 / (9 * dof));
+        double limit = dof * h * h * h;
+        printf("%c: chi squared %.2f on %g degrees of freedom, limit %.2f%s\n", (char)c, chiSquared, dof, limit,
+          chiSquared > limit ? " FAILED" : "");
+        if (chiSquared > limit) ok = false;
       }
-      axiom.resize(new_array.size());
-      memcpy(axiom.data(), new_array.data(), new_array.size());
-      ++iteration_count;
+      return ok;
+    }
+
+    /// interprets each distinct bracketed subtree once and writes its repeats as moved copies from the next rebuild on
+    /// deterministic trees only, this saves the turtle's work but not vertex memory, every copy is still in the mesh
+    /// a copy is not a rigid move of its source, so it cannot be drawn as a GPU instance of it: its colours follow its
+    /// place in the string, its leaves hang straight down whichever way it points and its base is its parent's ring
+    void setSubtreeCopying(bool copying){
+      worker_pause pause(this);
+      if (copying == isCopyingSubtrees) return;
+      isCopyingSubtrees = copying;
+      invalidateCounts();
+    }
+
+    /// returns how many of the last interpretation's vertices were copied rather than interpreted
+    int getCopiedVertices() const{
+      return copiedVertices;
     }
 
-    /// This function constructs the rules for the Lsyatem from the file
-    void constructLSystem(){
-      octet::string check;
-      check.set((char*)lSystemFile.data(), fileSize);
+    /// sets how many detail levels selectDetail() chooses between, level 0 being the tree itself
+    /// a level is used below pixels / 2^(level - 1) of projected size, give or take the hysteresis fraction
+    /// a new count drops the levels built so far, buildDetailLevels() then builds that many
+    void setDetailLevels(int count, float pixels, float hysteresis){
+      worker_pause pause(this);
+      count = count < 1 ? 1 : count > MAX_DETAIL_LEVELS ? MAX_DETAIL_LEVELS : count;
+      if (count != wantedDetailLevels) dropDetailLevels();
+      wantedDetailLevels = count;
+      detailPixels = pixels;
+      detailHysteresis = hysteresis;
+      if (currentDetail >= wantedDetailLevels) currentDetail = wantedDetailLevels - 1;
+    }
 
-      // check for errors in the text file
-      if (LS_DEBUG_PARSER) printf("\nContents of the check string are as follows:\n%s\n\n", check);
-      if (check.find("Message") == -1 || check.find("Alphabet") == -1 || check.find("Axiom") == -1 || check.find("Rules") == -1 ||
-        check.find("Angle") == -1 || check.find("Iterations") == -1){
-        printf("Failed to find all keyWords, check your text file\n");
-        assert(0);
+    /// builds the coarser levels of the current tree, they stop being drawn whenever the tree changes
+    /// level k is derived k generations less deep with k fewer sides, down to 2 sides where the tubes become
+    /// flat ribbons and the leaves single triangles, and is stretched to the size of the full tree
+    /// when asynchronous the worker builds them once it has caught up and update() uploads them, so this returns at once
+    void buildDetailLevels(){
+      if (isAsync){
+        std::lock_guard<std::mutex> guard(workerLock);
+        isDetailWanted = true;
+        workerWake.notify_all();
+        return;
       }
-      else{
-        printf("All Keywords have been found!\n");
-      }
-
-      // now put the lsystem rules into the containers
-      // first the Message
-      int a = 0, b = 0;
-      a = getPosition(lSystemFile, ':', a) + 1;
-      b = getPosition(lSystemFile, ';', a);
-      message.set((char*)&lSystemFile[a], b - a);
-
-      printf("Here is the message: %s\n", message);
-
-      // Now the alphabet
-      a = 0, b = 0;
-      a = check.find("Alphabet");
-      a += string("Alphabet").size() + 1;
-      b = getPosition(lSystemFile, ';', a);
-
-      for (int i = a; i < b; i++){
-        if (lSystemFile[i] != ',')
-          alphabet.push_back(lSystemFile[i]);
-      }
-
-      printf("Here is the Alphabet: %.*s\n", alphabet.size(), alphabet.data());
-
-      // Now the Axiom
-      a = 0, b = 0;
-      a = check.find("Axiom");
-      a += string("Axoim").size() + 1;
-      b = getPosition(lSystemFile, ';', a);
-
-      for (int i = a; i < b; i++){
-        if (lSystemFile[i] != ',')
-          startingAxiom = lSystemFile[i];
-      }
-
-      axiom.push_back(startingAxiom);
-
-      printf("Here is the Axiom: %.*s\n", axiom.size(), axiom.data());
-
-      // Now the rules
-      int noRules = 0;
-      string ruleLHS, ruleRHS;
-      a = 0, b = 0;
-      a = check.find("Rules");
-      a += string("Rules").size() + 1;
-      noRules = atoi((char*)&lSystemFile[a]);
-      if (LS_DEBUG_PARSER) printf("number of rules: %i\n", noRules);
-      a += 2;
-
-      // loop through the ammoutn of rules and add them to the hash map
-      for (int i = 0; i < noRules; ++i){
-        b = getPosition(lSystemFile, ';', a);
-        ruleLHS.set((char*)&lSystemFile[a], 1);
-        a += 2;
-        ruleRHS.set((char*)&lSystemFile[a], b - a);
-        if (LS_DEBUG_PARSER) printf("%s = %s\n", ruleLHS, ruleRHS);
-        rules[ruleLHS[0]] = ruleRHS;
-        a = b + 1;
-      }
-
-      // now find the Angle
-      a = 0, b = 0;
-      a = check.find("Angle");
-      a += string("Angle").size() + 1;
-      b = getPosition(lSystemFile, ';', a);
-      string temp;
-      temp.set((char*)&lSystemFile[a], b - a);
-      angle = atof(temp);
-      if (LS_DEBUG_PARSER) printf("The Angle is: %g\n", angle);
+      buildDetailBuilders(boundsMax - boundsMin);
+      uploadDetailLevels();
     }
 
-    /// this function returns a randomised slighlty altered copy of the original
-    float mutateFloat(float input){
-      float min = input * (1 - varience);
-      float max = input * (1 + varience);
-      return randNumGen.get(min, max);
+    /// returns the number of detail levels built for the current tree, 0 if buildDetailLevels() is needed
+    int getDetailLevels() const{
+      return numDetailLevels;
     }
 
-  public:
+    /// chooses the detail level for a tree of the given projected size in pixels
+    /// the level only moves once the size is a hysteresis fraction past the switch point, so a tree near one does not pop
+    int selectDetail(float pixels){
+      int level = currentDetail;
+      while (level + 1 < wantedDetailLevels && pixels < detailSwitch(level + 1) * (1 - detailHysteresis)) ++level;
+      while (level > 0 && pixels > detailSwitch(level) * (1 + detailHysteresis)) --level;
+      currentDetail = level;
+      return level;
+    }
 
-    /// default constructer
-    L_system(){
-      node = new scene_node();
-      _mesh = new mesh();
-      placementStack.push_back(mat4t());
-      numVtxs = 0;
-      iteration_count = 0;
-      randNumGen.set_seed(1);
+    /// returns a detail level's mesh, the finest built level if that one has not been built
+    mesh *getDetailMesh(int level){
+      if (level >= numDetailLevels) level = numDetailLevels - 1;
+      return level > 0 ? detailTrees[level]->_mesh : _mesh;
     }
 
-    /// These functions are to be used with the new framework ----------------------
+    /// returns the vertices in a detail level's mesh
+    int getDetailVertices(int level){
+      if (level >= numDetailLevels) level = numDetailLevels - 1;
+      return level > 0 ? detailTrees[level]->numVertices : numVertices;
+    }
 
-    /// this function calculates the vertices of a prism given a matrix from the matrix stack 
-    /// This code has been taken from Andy's geometery example and modified
-    void calculate_prism_vertices(mat4t &placement, vec3 colour){
+    /// returns the radius of the sphere around the tree's box, for working out its projected size
+    float getBoundingRadius() const{
+      return (boundsMax - boundsMin).length() * 0.5f;
+    }
 
-      vec3 pos0 = placement[3].xyz();
-      if (isStochastic){
-        vec3 temp = translateF;
-        temp[1] = mutateFloat(temp[1]);
-        placement.translate(temp);
+    /// returns the middle of the tree's box in its node's space
+    vec3 getBoundsCentre() const{
+      return (boundsMin + boundsMax) * 0.5f;
+    }
+
+    /// true once the mesh shows every change asked for, so building from it will not be wasted
+    bool isUpToDate() const{
+      return meshCurrent;
+    }
+
+    /// takes another tree's grammar, turtle parameters and current generation without deriving it again
+    /// the string is read where it is, so from must not change while this tree uses it
+    /// deriving on this tree writes to its own buffers, so many trees can share one generation
+    void useGeneration(const L_system &from){
+      worker_pause pause(this);
+      copyGrammar(from);
+      applyParams(from.currentParams());
+      if (from.isPacked){
+        // a packed string cannot be shared, this tree gets its own chars
+        ownAxiom();
+        from.unpackInto(*axiom);
       }
-      else{
-        placement.translate(translateF);
+      else if (!isStreaming){
+        axiom = const_cast<dynarray<char> *>(from.axiom);
+        params = const_cast<dynarray<float> *>(from.params);
+        isSharedAxiom = true;
       }
-      vec3 pos1 = placement[3].xyz();
+      iteration_count = from.iteration_count;
+      invalidateCounts();
+    }
 
-      mat4t rotation = placement.xyz();
+    /// sets the turning angle without rebuilding the mesh, like setSeed() it is for building with buildGeometry()
+    void setAngle(float degrees){
+      worker_pause pause(this);
+      angle = degrees;
+      framesValid = meshCurrent = false;
+      dropCachedMeshes();
+      dropDetailLevels();
+    }
 
-      for (size_t i = 0; i < VERTSPERFACE; ++i) {
-        float theta = i * 2.0f * 3.14159265f / VERTSPERFACE;
-        vtx->pos = pos0 + vec3p(cosf(theta) * radius, 0, sinf(theta) * radius) * rotation;
-        vtx->colour = make_color(colour[0], colour[1], colour[2]);
-        vtx++;
-        vtx->pos = pos1 + vec3p(cosf(theta) * radius, 0, sinf(theta) * radius) * rotation;
-        vtx->colour = make_color(colour[0], colour[1], colour[2]);
-        vtx++;
+    /// returns the turning angle
+    float getAngle() const{
+      return angle;
+    }
+
+    /// stops the parser printing the file and what it found
+    void setQuiet(bool quiet){
+      isQuiet = quiet;
+    }
+
+    /// alternates between two meshes so an upload never writes the mesh the last frame drew
+    /// getMesh() changes after every rebuild, so the mesh instance must be rebound
+    void setDoubleBuffered(bool doubleBuffered){
+      isDoubleBuffered = doubleBuffered;
+      backMesh = doubleBuffered ? new mesh() : 0;
+      backVertices = backIndices = backVertexCapacity = backIndexCapacity = -1;
+    }
+
+    /// rebuilds on a worker thread after parameter changes so the caller never waits for a large tree
+    /// call update() once a frame to upload finished builds, the generation and file functions still run in the caller
+    void setAsync(bool async){
+      if (async == isAsync) return;
+      if (!async){
+        stopWorker();
+        // catch up with anything the worker had not uploaded
+        applyParams(pending);
+        if (!meshCurrent){
+          rebuildBuilder();
+          uploadGeometry();
+        }
+        return;
       }
+      pending = currentParams();
+      builtVersion = requestVersion;
+      isAsync = true;
+      worker = std::thread([this]{ workerLoop(); });
+    }
 
- 
-      // make the triangles
-      uint32_t vn = 0;
-      for (size_t i = 0; i != VERTSPERFACE; ++i) {
-        /*
-        1---------3
-        |       / |
-        |    /    |   
-        | /       |
-        0---------2
-        */   
+    /// uploads the worker's finished build, returns true if it did so and getMesh() may have changed
+    /// detail levels the worker built for the tree on screen are uploaded as well, levels for an older request are dropped
+    bool update(){
+      if (!isAsync) return false;
+      std::lock_guard<std::mutex> guard(workerLock);
+      if (detailVersion >= 0){
+        if (detailVersion == requestVersion) uploadDetailLevels();
+        detailVersion = -1;
+        workerWake.notify_all();
+      }
+      if (!isReady) return false;
+      uploadGeometry();
+      meshCurrent = builtVersion == requestVersion;
+      isReady = false;
+      workerWake.notify_all();
+      return true;
+    }
 
-        idx[0] = vn + 0 + numVtxs;
-        idx[1] = ((vn + 3) % 6) + numVtxs;
-        idx[2] = vn + 1 + numVtxs;
-        idx += 3;
-        // printf("%u,%u,%u :", idx[-3], idx[-2], idx[-1]);
-        idx[0] = vn + 0 + numVtxs;
-        idx[1] = ((vn + 2) % 6) + numVtxs;
-        idx[2] = ((vn + 3) % 6) + numVtxs;
-        idx += 3;
-       // printf(" %u,%u,%u\n", idx[-3], idx[-2], idx[-1]);
-        vn += 2;
+    /// sets the number of threads used to rewrite the axiom, 0 uses every hardware thread and 1 forces the serial path
+    void setThreadCount(int count){
+      worker_pause pause(this);
+      threadCount = count < 0 ? 0 : count;
+    }
+
+    /// rewrites and interprets on pool's threads instead of the tree's own, 0 goes back to its own
+    /// pool must outlive the tree and only ever run one job at a time, so it suits trees built one after another
+    void setThreadPool(L_system_pool *pool){
+      worker_pause pause(this);
+      threadPool = pool ? pool : &ownThreads;
+    }
+
+    /// switches between storing each generation and streaming it from the rules on demand
+    /// streaming keeps memory at O(iterations) frames but every interpretation re-expands the rules
+    /// a grammar with productions is always stored, as its rules need each symbol's parameters and neighbours
+    void setStreaming(bool streaming){
+      worker_pause pause(this);
+      if (hasProductions) streaming = false;
+      if (streaming == isStreaming) return;
+      if (streaming) setPacked(false);
+      int target = iteration_count;
+      resetAxiom();
+      isStreaming = streaming;
+      iteration(target);
+    }
+
+    /// stores each generation as 4 bit codes, two symbols to a byte, which halves the memory and bandwidth of a deep tree
+    /// derivation and interpretation read the codes directly, but the generation cache, subtree copying and parallel interpretation
+    /// need the chars and are skipped. the grammar can reach at most 16 symbols and has no productions, otherwise this returns false
+    /// and the strings stay as they are. a streamed tree is not packed, it has no string to pack
+    bool setPacked(bool packing){
+      worker_pause pause(this);
+      if (packing && (isStreaming || hasProductions || !compileCodes())) packing = false;
+      if (packing == isPacked) return packing;
+      if (packing){
+        clearGenerationCache();
+        isPacked = true;
+        packAxiom();
+      }
+      else{
+        ownAxiom();
+        unpackInto(*axiom);
+        packedBuffers[0].reset();
+        packedBuffers[1].reset();
+        packedLength = 0;
+        isPacked = false;
       }
-      // this is number of vertices added
-      numVtxs += 6;
+      invalidateCounts();
+      return packing;
+    }
 
+    /// returns true if the generations are stored as 4 bit codes
+    bool getPacked() const{
+      return isPacked;
     }
 
-    // this function calculates the vertices required for a downwards facing cone ~ a leafish
-    void calculate_cone_vertices(mat4t placement){
+    /// keeps every derived generation, and optionally its mesh, within budget bytes so stepping between them is a lookup
+    /// generations that do not fit are derived from the deepest cached generation below them, 0 turns the cache off
+    void setGenerationCache(size_t budget, bool cacheGeometry){
+      worker_pause pause(this);
+      clearGenerationCache();
+      cacheBudget = budget;
+      isCachingGeometry = cacheGeometry;
+      storeGeneration();
+    }
+
+    /// moves to the given generation, from the cache where possible, and rebuilds the mesh
+    void setGeneration(int target){
+      worker_pause pause(this);
+      if (target < 0) target = 0;
+      stashMesh();
+
+      int start = -1;
+      if (!isStreaming && !isPacked){
+        for (int g = target < MAX_CACHED_GENERATIONS ? target : MAX_CACHED_GENERATIONS - 1; g >= 0; --g){
+          if (generationCache[g].size()){
+            start = g;
+            break;
+          }
+        }
+      }
 
+      if (target >= iteration_count && start <= iteration_count){
+        // carrying on from the current generation is at least as good as any checkpoint
+      }
+      else if (start < 0){
+        resetAxiom();
+      }
+      else if (start != iteration_count){
+        ownAxiom();
+        axiom->resize(generationCache[start].size());
+        memcpy(axiom->data(), generationCache[start].data(), axiom->size());
+        iteration_count = start;
+        invalidateCounts();
+      }
+
+      iteration(target - iteration_count);
+      if (!restoreMesh()){
+        regenerate();
+      }
+    }
+
+    /// the prism writer as it was before the ring table, kept as the reference for benchmarkGeometry()
+    void calculate_prism_vertices_reference(turtle_context &t, const mat4t &placement, vec3 pos1, vec3 colour){
+      myVertex *vtx = t.vtx;
+      uint32_t *idx = t.idx;
+      int numVtxs = t.numVtxs;
       vec3 pos0 = placement[3].xyz();
-      vec3 pos1 = vec3(pos0[0], pos0[1] - 0.5f, pos0[2]);
+      mat4t rotation = placement.xyz();
 
-      for (size_t i = 0; i < VERTSPERFACE; ++i) {
-        float theta = i * 2.0f * 3.14159265f / VERTSPERFACE;
-        vtx->pos = pos0;
-        vtx->colour = make_color(0, 1.0f, 0.5f);
+      for (int i = 0; i < sides; ++i) {
+        float theta = i * 2.0f * 3.14159265f / sides;
+        vtx->pos = pos0 + vec3p(cosf(theta) * radius, 0, sinf(theta) * radius) * rotation;
+        vtx->colour = make_color(colour[0], colour[1], colour[2]);
         vtx++;
-        vtx->pos = pos1 + vec3p(cosf(theta) * radius, 0, sinf(theta) * radius);
-        vtx->colour = make_color(0, 1.0f, 0.5f);
+        vtx->pos = pos1 + vec3p(cosf(theta) * radius, 0, sinf(theta) * radius) * rotation;
+        vtx->colour = make_color(colour[0], colour[1], colour[2]);
         vtx++;
       }
 
-      // make the triangles
-      uint32_t vn = 0;
-      for (size_t i = 0; i != VERTSPERFACE; ++i) {
-        /*
-        1---------3
-        |       / |
-        |    /    |
-        | /       |
-        0---------2
-        */
-
+      uint32_t vn = 0, ring = 2 * sides;
+      for (int i = 0; i != sides; ++i) {
         idx[0] = vn + 0 + numVtxs;
-        idx[1] = ((vn + 3) % 6) + numVtxs;
+        idx[1] = ((vn + 3) % ring) + numVtxs;
         idx[2] = vn + 1 + numVtxs;
         idx += 3;
-        // printf("%u,%u,%u :", idx[-3], idx[-2], idx[-1]);
         idx[0] = vn + 0 + numVtxs;
-        idx[1] = ((vn + 2) % 6) + numVtxs;
-        idx[2] = ((vn + 3) % 6) + numVtxs;
+        idx[1] = ((vn + 2) % ring) + numVtxs;
+        idx[2] = ((vn + 3) % ring) + numVtxs;
         idx += 3;
-        // printf(" %u,%u,%u\n", idx[-3], idx[-2], idx[-1]);
         vn += 2;
       }
-      // this is number of vertices added
-      numVtxs += 6;
+      t.vtx = vtx;
+      t.idx = idx;
+      t.numVtxs = numVtxs + ring;
     }
 
-    /// This function interprets the axiom to populate the mesh
-    void interpret_axiom(){
-
-      numVtxs = 0;
-      mat4t matrix;
-      int i = 0;
-      vec3 colour;
-      
-      // for each char in axiom do x
-      for each (char c in axiom)
-      {
-        ++i;
-        colour = green * i / axiom.size() + brown * (axiom.size() - i) / axiom.size();
-
-        switch (c){
-        case 'F':
-          // draw a prism
-          calculate_prism_vertices(placementStack.back(), colour);
-          break;
-        case '[':
-          // push a matrix onto the stack
-          matrix = placementStack.back();
-          placementStack.push_back(matrix);
-          break;
-        case ']':
-          // pop a matrix off the stack
-          calculate_cone_vertices(placementStack.back());
-          placementStack.pop_back();
-          break;
-        case '+':
-          // rotate around z +ve
-          if (!isStochastic){
-            placementStack.back().rotateZ(angle);
-          }
-          else{
-            placementStack.back().rotateX(mutateFloat(angle));
-            placementStack.back().rotateY(mutateFloat(angle));
-            placementStack.back().rotateZ(mutateFloat(angle));
-          }
-          break;
-        case '-':
-          // rotate around z -ve
-          if (!isStochastic){
-            placementStack.back().rotateZ(-angle);
-          }
-          else{
-            placementStack.back().rotateX(mutateFloat(-angle));
-            placementStack.back().rotateY(mutateFloat(-angle));
-            placementStack.back().rotateZ(mutateFloat(-angle));
-          }
-          break;
-        case '<':
-          // rotate around y -ve
-          if (!isStochastic){
-            placementStack.back().rotateY(angle);
-          }
-          else{
-            placementStack.back().rotateX(mutateFloat(angle));
-            placementStack.back().rotateY(mutateFloat(angle));
-            placementStack.back().rotateZ(mutateFloat(angle));
-          }
-          break;
-        case '>':
-          // rotate around y +ve
-          if (!isStochastic){
-            placementStack.back().rotateY(-angle);
-          }
-          else{
-            placementStack.back().rotateX(mutateFloat(-angle));
-            placementStack.back().rotateY(mutateFloat(-angle));
-            placementStack.back().rotateZ(mutateFloat(-angle));
-          }
-          break;
-        case '^':
-          // rotate around x +ve
-          if (!isStochastic){
-            placementStack.back().rotateX(angle);
-          }
-          else{
-            placementStack.back().rotateX(mutateFloat(-angle));
-            placementStack.back().rotateY(mutateFloat(-angle));
-            placementStack.back().rotateZ(mutateFloat(-angle));
-          }
-          break;
-        case '*':
-          // rotate around x -ve
-          if (!isStochastic){
-            placementStack.back().rotateX(-angle);
-          }
-          else{
-            placementStack.back().rotateX(mutateFloat(-angle));
-            placementStack.back().rotateY(mutateFloat(-angle));
-            placementStack.back().rotateZ(mutateFloat(-angle));
-          }
-          break;
-        default:
-          break;
-        }
-        
+    /// times the reference prism writer against the ring table kernel on count random segments
+    /// returns false if the kernel's prisms are not the reference's, its rings are written one after the other
+    /// where the reference interleaves them, so vertex 2k of a reference prism is ring vertex k and 2k + 1 is sides + k
+    bool benchmarkGeometry(int count){
+      worker_pause pause(this);
+      typedef std::chrono::high_resolution_clock clock;
+      dynarray<mat4t> placements;
+      dynarray<segment_frame> frames;
+      dynarray<myVertex> refVertices, vertices;
+      dynarray<uint32_t> refIndices, indices;
+      random rng(0x1234);
+
+      buildRingTable();
+      placements.resize(count);
+      frames.resize(count);
+      refVertices.resize(count * 2 * sides);
+      refIndices.resize(count * 6 * sides);
+      vertices.resize(count * 2 * sides);
+      indices.resize(count * 6 * sides);
+      for (int i = 0; i != count; ++i){
+        mat4t &m = placements[i];
+        m.translate(vec3(rng.get(-10.0f, 10.0f), rng.get(-10.0f, 10.0f), rng.get(-10.0f, 10.0f)));
+        m.rotateX(rng.get(-180.0f, 180.0f));
+        m.rotateZ(rng.get(-180.0f, 180.0f));
+        mat4t top = m;
+        top.translate(translateF);
+        mat4t rotation = m.xyz();
+        segment_frame &f = frames[i];
+        f.pos0 = m[3].xyz();
+        f.pos1 = top[3].xyz();
+        f.xAxis = vec3p(1, 0, 0) * rotation;
+        f.zAxis = vec3p(0, 0, 1) * rotation;
+        f.colour = make_color(brown[0], brown[1], brown[2]);
+        f.symbol = 0;
+        f.width = 1;
+        f.isCone = false;
+        f.isWelded = false;
       }
-    }
 
-    /// This fucntion sets up th mesh to be drawn, taken and edited from Andy's geometry example
-    void initialiseDrawParams() {
+      turtle_context t;
+      bool savedIndicesValid = indicesValid;
+      indicesValid = false;
 
-      int num = 0;
-      for (int i = 0; i < axiom.size(); ++i){
-        if (axiom[i] == 'F' || axiom[i] == ']') {
-          ++num;
-        }
+      t.vtx = refVertices.data();
+      t.idx = refIndices.data();
+      t.numVtxs = 0;
+      clock::time_point t0 = clock::now();
+      for (int i = 0; i != count; ++i){
+        calculate_prism_vertices_reference(t, placements[i], frames[i].pos1, brown);
       }
+      clock::time_point t1 = clock::now();
+
+      myVertex *vtx = vertices.data();
+      uint32_t *idx = indices.data();
+      int numVtxs = 0;
+      clock::time_point t2 = clock::now();
+      for (int i = 0; i != count; ++i){
+        vtx = write_segment_vertices(frames[i], vtx);
+        idx = write_tube_indices(idx, numVtxs, numVtxs + sides);
+        numVtxs += 2 * sides;
+      }
+      clock::time_point t3 = clock::now();
 
-      _mesh->init();
-
-      // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-      // allocate vertices and indices into OpenGL buffers
-      size_t num_vertices = num * 6;
-      size_t num_indices = num * 6 * VERTSPERFACE;
-      _mesh->allocate(sizeof(myVertex) * num_vertices, sizeof(uint32_t) * num_indices);
-      _mesh->set_params(sizeof(myVertex), num_indices, num_vertices, GL_TRIANGLES, GL_UNSIGNED_INT);
+      indicesValid = savedIndicesValid;
 
-      // describe the structure of my_vertex to OpenGL
-      _mesh->add_attribute(attribute_pos, 3, GL_FLOAT, 0);
-      _mesh->add_attribute(attribute_color, 4, GL_UNSIGNED_BYTE, 12, GL_TRUE);
+      double refSec = std::chrono::duration<double>(t1 - t0).count();
+      double newSec = std::chrono::duration<double>(t3 - t2).count();
 
+      int ring = 2 * sides, wrong = 0;
+      for (int i = 0; i != count * ring; ++i){
+        int base = i - i % ring, local = i % ring;
+        const myVertex &a = refVertices[i], &b = vertices[base + (local & 1) * sides + (local >> 1)];
+        vec3 pa = a.pos, pb = b.pos;
+        wrong += (pa - pb).length() > 1e-4f * (1 + pa.length()) || a.colour != b.colour;
+      }
+      for (int i = 0; i != count * 6 * sides; ++i){
+        uint32_t r = refIndices[i], base = r - r % ring, local = r % ring;
+        wrong += indices[i] != base + (local & 1) * sides + (local >> 1);
+      }
 
-      // these write-only locks give access to the vertices and indices.
-      // they will be released at the next } (the end of the scope)
-      gl_resource::wolock vl(_mesh->get_vertices());
-      vtx = (myVertex *)vl.u8();
-      gl_resource::wolock il(_mesh->get_indices());
-      idx = il.u32();
+      printf("segments: %i, reference: %.0f segments/s, ring table%s: %.0f segments/s%s\n", count,
+        refSec > 0 ? count / refSec : 0.0, LS_USE_SSE ? " + SSE" : "", newSec > 0 ? count / newSec : 0.0,
+        wrong ? " MISMATCH" : "");
+      return !wrong;
     }
 
-    /// ----------------------------------------------------------------------------
+    /// builds the generation at depth with every subtree interpreted and then with the subtree copying mode, and times both
+    /// returns false if the copies are not what the interpreter writes, indices and colours exactly and positions to rounding
+    bool benchmarkSubtreeCopying(int depth){
+      worker_pause pause(this);
+      typedef std::chrono::high_resolution_clock clock;
+      dynarray<myVertex> refVertices, vertices;
+      dynarray<uint32_t> refIndices, indices;
+
+      if (isStochastic || isStreaming || hasParameters){
+        printf("the subtree copying mode only copies deterministic trees without parameters, skipped\n");
+        return true;
+      }
+      deriveGeneration(depth);
+      bool wasCopying = isCopyingSubtrees;
+      isCopyingSubtrees = false;
+      clock::time_point t0 = clock::now();
+      buildGeometry(refVertices, refIndices);
+      clock::time_point t1 = clock::now();
+      isCopyingSubtrees = true;
+      buildGeometry(vertices, indices);
+      clock::time_point t2 = clock::now();
+      isCopyingSubtrees = wasCopying;
+      invalidateCounts();
+
+      int wrong = refVertices.size() != vertices.size() || refIndices.size() != indices.size();
+      for (int i = 0; !wrong && i != vertices.size(); ++i){
+        vec3 pa = refVertices[i].pos, pb = vertices[i].pos;
+        wrong += (pa - pb).length() > 1e-4f * (1 + pa.length()) || refVertices[i].colour != vertices[i].colour;
+      }
+      for (int i = 0; !wrong && i != indices.size(); ++i){
+        wrong += refIndices[i] != indices[i];
+      }
 
-    /// Parser function, used to read all info from txt file
-    void loadFile(string name){
-      app_utils::get_url(lSystemFile, name);
+      double refMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+      double newMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+      printf("depth: %i, vertices: %u, copied: %.1f%%, interpreted: %.3f ms, copying: %.3f ms, %.2fx%s\n", iteration_count,
+        vertices.size(), vertices.size() ? 100.0 * copiedVertices / vertices.size() : 0.0, refMs, newMs,
+        newMs > 0 ? refMs / newMs : 0.0, wrong ? " MISMATCH" : "");
+      return !wrong;
+    }
 
-      printf("The file has been read\n");
-      printf("%.*s\n", lSystemFile.size(), (char*)lSystemFile.data());
-      fileSize = lSystemFile.size();
+    /// Get functions below /// ==================================================================
 
-      removeWhiteSpace(lSystemFile);
-      constructLSystem();
+    /// returns axiom's size
+    int getAxiomSize(){
+      if (isPacked) return packedLength;
+      if (isStreaming){
+        uint8_t all[256];
+        memset(all, 1, sizeof(all));
+        return (int)countDerivedSymbols(all);
+      }
+      return axiom->size();
     }
 
-    /// This function iterates the axiom the number of times given
-    void iteration(int numb){
-      for (int i = 0; i < numb; ++i){
-        iterate();
-      }
+    /// returns the phase times and counters of this tree's builds
+    const L_system_profile &getProfile() const{
+      return profile;
     }
 
-    /// Get functions below /// ==================================================================
+    /// forgets the times and counters, to profile from a known point
+    void resetProfile(){
+      profile.reset();
+    }
 
-    /// returns axiom's size
-    int getAxiomSize(){
-      return axiom.size();
+    /// writes the profile as a Chrome trace, returns false if the file could not be written
+    bool writeProfileTrace(const char *path) const{
+      return profile.writeTrace(path);
+    }
+
+    /// returns the bytes held by the strings, parameters, geometry and generation cache of this tree
+    size_t memoryBytes() const{
+      size_t bytes = cacheBytes;
+      for (int i = 0; i != 2; ++i){
+        bytes += axiomBuffers[i].size() + packedBuffers[i].size() + paramBuffers[i].size() * sizeof(float);
+      }
+      bytes += builder.vertices.size() * sizeof(myVertex) + builder.indices.size() * sizeof(uint32_t);
+      bytes += segmentFrames.size() * sizeof(segment_frame) + successorPool.size();
+      return bytes;
     }
 
     /// returns the scene node
@@ -493,88 +3802,63 @@ namespace octet{
 
     /// increments current iterations
     void incrementIteration(){
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      iterate();
-      initialiseDrawParams();
-      interpret_axiom();
+      setGeneration(iteration_count + 1);
     }
 
     /// increments current iterations
     void incrementRadius(){
-      radius += 0.05f;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.radius += 0.05f; });
     }
 
     /// increments current iterations
     void decrementRadius(){
-      radius -= 0.05f;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.radius -= 0.05f; });
     }
 
     /// deccrements current iterations
     void decrementIteration(){
       int target = (iteration_count != 1) ? iteration_count - 1 : 0;
-      iteration_count = 0;
-      axiom.reset();
-      axiom.resize(1);
-      axiom.push_back(startingAxiom);
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      iteration(target);
-      initialiseDrawParams();
-      interpret_axiom();
+      setGeneration(target);
     }
 
     /// increment angle by 1degree
     void incrementAngle(){
-      angle += 1.0f;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.angle += 1.0f; });
     }
 
     /// decrment angle by 1.0f degrees
     void decrementAngle() {
-      angle -= 1.0f;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.angle -= 1.0f; });
     }
 
     /// increment the translation magnitude
     void incrementTranslation(){
-      translateF[1] += 0.02f;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.translate[1] += 0.02f; });
     }
 
     /// increment the translation magnitude
     void decrementTranslation(){
-      translateF[1] -= 0.02f;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.translate[1] -= 0.02f; });
+    }
+
+    /// sets the number of vertices in each ring of the tubes, from 3 to MAX_SIDES
+    void setSides(int count){
+      editParams([=](turtle_params &p){ p.sides = count < 3 ? 3 : count > MAX_SIDES ? MAX_SIDES : count; });
+    }
+
+    /// adds a side to the tubes
+    void incrementSides(){
+      editParams([](turtle_params &p){ p.sides = p.sides < MAX_SIDES ? p.sides + 1 : MAX_SIDES; });
+    }
+
+    /// removes a side from the tubes
+    void decrementSides(){
+      editParams([](turtle_params &p){ p.sides = p.sides > 3 ? p.sides - 1 : 3; });
     }
 
     /// change the generation to and from stochastic
     void altStochasticity(){
-      isStochastic = !isStochastic;
-      placementStack.reset();
-      placementStack.push_back(mat4t());
-      initialiseDrawParams();
-      interpret_axiom();
+      editParams([](turtle_params &p){ p.stochastic = !p.stochastic; });
     }
   };
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// Headless batch generator for L - Systems, see L_system_batch.h for the options
+//
+
+#include "L_system_batch.h"
+
+int main(int argc, char **argv) {
+  octet::L_system_batch batch;
+  if (!batch.parseArgs(argc, argv)) return 1;
+  return batch.run();
+}
@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// Headless batch generator for L - Systems
+//
+// lsystems_batch [-d depths] [-s seeds] [-j threads] [-o directory] [-z] grammar files...
+//
+//   -d  generations to build, a list of numbers and ranges such as 3,5-7 (default 4)
+//   -s  seeds for the stochastic mode, same format (default 1)
+//   -j  worker threads, 0 uses every hardware thread (default 0)
+//   -o  directory the .ply files are written to, it must exist (default .)
+//   -z  turn on the stochastic mode, without it every seed builds the same tree
+//       unless the grammar has weighted rules
+//
+// Every grammar is built at every depth with every seed and written as
+// <grammar>_d<depth>_s<seed>.ply without opening a window or an OpenGL context.
+//
+
+#include <atomic>
+#include "L_system_tool.h"
+
+namespace octet {
+  /// Builds many trees from the command line and writes them as binary .ply files
+  class L_system_batch {
+    typedef L_system::myVertex myVertex;
+
+    /// one tree to build
+    struct batch_job {
+      int file;
+      int depth;
+      unsigned seed;
+    };
+
+    dynarray<string> files;
+    dynarray<int> depths;
+    dynarray<int> seeds;
+    dynarray<batch_job> jobs;
+    string outputDir;
+    int threadCount;
+    bool isStochastic;
+
+    // shared between the workers
+    std::atomic<int> nextJob;
+    std::atomic<int> failures;
+    std::atomic<uint64_t> symbolsBuilt;
+    std::atomic<uint64_t> bytesWritten;
+
+    /// writes the triangles as a binary little endian .ply, returns the bytes written or 0 on failure
+    /// myVertex is three floats followed by rgba bytes, so the vertices go out as they are
+    static uint64_t writePly(const char *path, dynarray<myVertex> &vertices, dynarray<uint32_t> &indices, dynarray<uint8_t> &faceBuffer){
+      FILE *file = fopen(path, "wb");
+      if (!file) return 0;
+
+      int numFaces = indices.size() / 3;
+      char header[512];
+      int headerSize = snprintf(header, sizeof(header),
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "element vertex %d\n"
+        "property float x\nproperty float y\nproperty float z\n"
+        "property uchar red\nproperty uchar green\nproperty uchar blue\nproperty uchar alpha\n"
+        "element face %d\n"
+        "property list uchar uint vertex_indices\n"
+        "end_header\n",
+        vertices.size(), numFaces
+      );
+
+      // each face is a count byte followed by three indices
+      enum { FACE_BYTES = 1 + 3 * sizeof(uint32_t) };
+      faceBuffer.resize(numFaces * FACE_BYTES);
+      uint8_t *dest = faceBuffer.data();
+      for (int i = 0; i != numFaces; ++i){
+        *dest = 3;
+        memcpy(dest + 1, &indices[i * 3], 3 * sizeof(uint32_t));
+        dest += FACE_BYTES;
+      }
+
+      bool ok = fwrite(header, 1, headerSize, file) == (size_t)headerSize;
+      ok = ok && fwrite(vertices.data(), sizeof(myVertex), vertices.size(), file) == (size_t)vertices.size();
+      ok = ok && fwrite(faceBuffer.data(), 1, faceBuffer.size(), file) == (size_t)faceBuffer.size();
+      ok = fclose(file) == 0 && ok;
+      return ok ? (uint64_t)headerSize + sizeof(myVertex) * vertices.size() + faceBuffer.size() : 0;
+    }
+
+    /// takes jobs until there are none left
+    /// a worker keeps its tree while the grammar and depth stay the same, so only the first seed derives the string
+    /// apart from grammars with weighted rules, which setSeed() derives again
+    /// the grammar file is only read again when the worker moves on to another grammar, a new depth is derived from
+    /// the parsed grammar it has, and a new grammar is loaded into the same tree, so its buffers are reused from job to job
+    void worker(){
+      ref<L_system> tree = new L_system();
+      tree->setQuiet(true);
+      tree->setThreadCount(1);
+      int treeFile = -1, treeDepth = -1;
+      dynarray<myVertex> vertices;
+      dynarray<uint32_t> indices;
+      dynarray<uint8_t> faceBuffer;
+
+      for (int j = nextJob++; j < jobs.size(); j = nextJob++){
+        const batch_job &job = jobs[j];
+        if (job.file != treeFile){
+          if (!tree->switchFile(files[job.file])){
+            treeFile = -1;
+            failures++;
+            continue;
+          }
+          tree->setStochastic(isStochastic);
+          treeFile = job.file;
+          treeDepth = 0;
+        }
+        if (job.depth != treeDepth){
+          tree->deriveGeneration(job.depth);
+          treeDepth = job.depth;
+        }
+
+        tree->setSeed(job.seed);
+        tree->buildGeometry(vertices, indices);
+
+        string path;
+        path.format("%s/%s_d%d_s%u.ply", outputDir.c_str(), L_system_tool::baseName(files[job.file]).c_str(), job.depth, job.seed);
+        uint64_t bytes = writePly(path, vertices, indices, faceBuffer);
+        if (!bytes){
+          printf("could not write %s\n", path.c_str());
+          failures++;
+          continue;
+        }
+        bytesWritten += bytes;
+        symbolsBuilt += tree->getAxiomSize();
+      }
+    }
+
+  public:
+    L_system_batch() :
+      outputDir("."),
+      threadCount(0),
+      isStochastic(false),
+      nextJob(0),
+      failures(0),
+      symbolsBuilt(0),
+      bytesWritten(0)
+    {
+      depths.push_back(4);
+      seeds.push_back(1);
+    }
+
+    /// reads the options and grammar files, prints the usage and returns false if they make no sense
+    bool parseArgs(int argc, char **argv){
+      for (int i = 1; i < argc; ++i){
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-d") && hasValue){
+          if (!L_system_tool::parseList(argv[++i], depths)) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-s") && hasValue){
+          if (!L_system_tool::parseList(argv[++i], seeds)) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-j") && hasValue){
+          threadCount = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "-o") && hasValue){
+          outputDir = argv[++i];
+        }
+        else if (!strcmp(arg, "-z")){
+          isStochastic = true;
+        }
+        else if (arg[0] == '-'){
+          return usage(argv[0]);
+        }
+        else{
+          files.push_back(string(arg));
+        }
+      }
+      return files.size() != 0 || usage(argv[0]);
+    }
+
+    bool usage(const char *program){
+      printf("usage: %s [-d depths] [-s seeds] [-j threads] [-o directory] [-z] grammar files...\n", program);
+      printf("  depths and seeds are lists and ranges, e.g. -d 3,5-7 -s 1-100\n");
+      return false;
+    }
+
+    /// builds every tree, prints the throughput and returns the process exit code
+    int run(){
+      jobs.resize(0);
+      for (int f = 0; f != files.size(); ++f){
+        for (int d = 0; d != depths.size(); ++d){
+          for (int s = 0; s != seeds.size(); ++s){
+            batch_job job = { f, depths[d], (unsigned)seeds[s] };
+            jobs.push_back(job);
+          }
+        }
+      }
+
+      int threads = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+      if (threads < 1) threads = 1;
+      if (threads > jobs.size()) threads = jobs.size();
+
+      auto start = std::chrono::high_resolution_clock::now();
+      std::vector<std::thread> pool;
+      for (int i = 1; i < threads; ++i){
+        pool.emplace_back([this]{ worker(); });
+      }
+      worker();
+      for (auto &thread : pool){
+        thread.join();
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+      if (seconds <= 0) seconds = 1e-9;
+
+      int built = jobs.size() - failures;
+      printf("%d trees in %.3fs on %d threads\n", built, seconds, threads);
+      printf("%.1f trees/s, %.3g symbols/s, %.3g MB/s (%llu bytes written)\n",
+        built / seconds, (double)symbolsBuilt / seconds, (double)bytesWritten / seconds / (1024 * 1024),
+        (unsigned long long)bytesWritten);
+      return failures ? 1 : 0;
+    }
+  };
+}
@@ -0,0 +1,14 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// Headless benchmark for L - Systems, see L_system_bench.h for the options
+//
+
+#include "L_system_bench.h"
+
+int main(int argc, char **argv) {
+  octet::L_system_bench bench;
+  if (!bench.parseArgs(argc, argv)) return 1;
+  return bench.run();
+}
@@ -0,0 +1,440 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// Headless benchmark for L - Systems
+//
+// lsystems_bench [-d depths] [-r repeats] [-j threads] [-m modes] [-p] [-o file] [-b baseline] [-t percent] [grammar files...]
+// lsystems_bench [-w samples] [-i depth] [-g segments] [-n depth] [-c generation] [-e generation] [-s generation] [-l rules] [grammar files...]
+//
+//   -d  generations to time, a list of numbers and ranges such as 3,5-7 (default 2-6)
+//   -r  times each case is built, the statistics are over these (default 9)
+//   -j  worker threads each tree uses, 0 uses every hardware thread (default 1)
+//   -m  d for the deterministic mode, s for the stochastic mode or ds for both (default ds)
+//   -p  store the strings as 4 bit codes, see L_system::setPacked()
+//   -o  file the results are written to as JSON (default lsystems_bench.json)
+//   -b  results of an earlier run to compare against
+//   -t  percent a median may grow by before it counts as a regression (default 10)
+//   -w  check the weighted rules of every grammar that has them with this many samples,
+//       see L_system::testRuleDistribution()
+//   -i  check the two pass rewrite against the reference rewrite up to this depth and time both,
+//       see L_system::benchmarkIteration()
+//   -g  check the ring table prism writer against the reference writer on this many random
+//       segments with each grammar's radius and sides and time both, see L_system::benchmarkGeometry()
+//   -n  check the subtree copying mode's copies against the interpreter at this depth and time both,
+//       see L_system::benchmarkSubtreeCopying()
+//   -c  check a cache file of this generation loads back to the same mesh and that stale, cut short
+//       and damaged files are refused, see L_system::testCache()
+//   -e  check that reloading a copy of each grammar with its last rule edited at this generation
+//       builds what a fresh load of the edit does, see L_system::testReload()
+//   -s  check that the streaming, parallel and packed paths derive and build this generation byte for byte
+//       as the serial path does, deterministic and stochastic, see L_system::testModes()
+//   -l  time the parser on generated grammars of up to this many rules and check they all parse,
+//       once rather than for each grammar, see L_system::benchmarkParser()
+//
+// Without grammar files every tree in assets/Lsystems is timed. For each grammar,
+// depth and mode it times, apart from one another:
+//   derive     loading nothing, just iteration() to the depth
+//   interpret  counting and interpreting the generation into plain buffers
+//   radius     a radius tweak, which rewrites the vertices from the kept frames
+//   angle      an angle tweak, which walks the turtle over the string again
+// and writes the median, 90th and 99th percentiles, throughput and memory of each
+// without opening a window or an OpenGL context. With -b the exit code is 1 if
+// any median is more than the threshold slower than the baseline's.
+//
+// A check option runs its check on every grammar instead of the timings, and the
+// exit code is 1 if any check fails.
+//
+
+#include "L_system_tool.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <sys/resource.h>
+#endif
+
+namespace octet {
+  /// Times every phase of building trees from the command line and compares the times with a baseline
+  class L_system_bench {
+    typedef L_system::myVertex myVertex;
+
+    enum phase { PHASE_DERIVE, PHASE_INTERPRET, PHASE_RADIUS, PHASE_ANGLE, NUM_PHASES };
+
+    /// symbols in each rule of the grammars -l generates
+    enum { PARSER_RULE_LENGTH = 256 };
+
+    /// where -c writes its cache files, under the working directory
+    static const char *cacheDir() { return "bench_cache"; }
+
+    /// the scratch grammar -e edits, under the working directory
+    static const char *reloadPath() { return "bench_reload.txt"; }
+
+    /// medians below this are noise, they are never called regressions
+    static double noiseFloorMs() { return 0.05; }
+
+    /// the spread of one phase's samples
+    struct bench_stats{
+      double minMs;
+      double medianMs;
+      double p90Ms;
+      double p99Ms;
+      double maxMs;
+    };
+
+    /// one grammar at one depth in one mode
+    struct bench_result{
+      string grammar;
+      int depth;
+      bool stochastic;
+      uint64_t symbols;       // in the derived generation
+      uint64_t vertices;
+      uint64_t treeBytes;     // L_system::memoryBytes() once built
+      uint64_t peakBytes;     // the process's peak resident size after the case
+      bench_stats phases[NUM_PHASES];
+    };
+
+    dynarray<string> files;
+    dynarray<int> depths;
+    dynarray<bench_result> results;
+    string outputPath;
+    string baselinePath;
+    double threshold;
+    int repeats;
+    int threadCount;
+    bool modes[2];          // deterministic, stochastic
+    bool isPacked;
+    int ruleSamples;        // -w, 0 leaves the check out
+    int iterationDepth;     // -i, 0 leaves the check out
+    int geometrySegments;   // -g, 0 leaves the check out
+    int copyingDepth;       // -n, 0 leaves the check out
+    int cacheGeneration;    // -c, -1 leaves the check out
+    int reloadGeneration;   // -e, -1 leaves the check out
+    int modesGeneration;    // -s, -1 leaves the check out
+    int parserRules;        // -l, 0 leaves the check out
+
+    static const char *phaseName(int index){
+      static const char *names[NUM_PHASES] = { "derive", "interpret", "radius", "angle" };
+      return names[index];
+    }
+
+    /// the largest the process has been, 0 where the system does not say
+    static uint64_t peakResidentBytes(){
+    #if defined(__APPLE__)
+      struct rusage usage;
+      return getrusage(RUSAGE_SELF, &usage) ? 0 : (uint64_t)usage.ru_maxrss;
+    #elif defined(__unix__)
+      struct rusage usage;
+      return getrusage(RUSAGE_SELF, &usage) ? 0 : (uint64_t)usage.ru_maxrss * 1024;
+    #else
+      return 0;
+    #endif
+    }
+
+    static double elapsedMs(std::chrono::high_resolution_clock::time_point start){
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    /// sorts the samples and picks the nearest rank percentiles
+    static bench_stats summarise(dynarray<double> &samples){
+      std::sort(samples.begin(), samples.end());
+      int n = samples.size();
+      auto rank = [&](double p){
+        int i = (int)ceil(p * n) - 1;
+        return samples[i < 0 ? 0 : i];
+      };
+      bench_stats stats = { samples[0], rank(0.5), rank(0.9), rank(0.99), samples[n - 1] };
+      return stats;
+    }
+
+    /// builds one grammar at one depth repeats times, each time on a new tree, and keeps the spread of each phase
+    /// returns false if the grammar would not load
+    bool runCase(const char *file, int depth, bool stochastic, bench_result &result){
+      dynarray<double> samples[NUM_PHASES];
+      dynarray<myVertex> vertices;
+      dynarray<uint32_t> indices;
+      typedef std::chrono::high_resolution_clock clock;
+
+      for (int r = 0; r != repeats; ++r){
+        ref<L_system> tree = new L_system();
+        tree->setQuiet(true);
+        tree->setThreadCount(threadCount);
+        if (!tree->loadFile(file)) return false;
+        tree->setStochastic(stochastic);
+        tree->setSeed(1 + r);
+        tree->setPacked(isPacked);
+
+        clock::time_point start = clock::now();
+        tree->iteration(depth);
+        samples[PHASE_DERIVE].push_back(elapsedMs(start));
+
+        start = clock::now();
+        tree->buildGeometry(vertices, indices);
+        samples[PHASE_INTERPRET].push_back(elapsedMs(start));
+
+        // the first rebuild sizes the builder, the tweaks after it are what a held key costs
+        tree->rebuildEdited([](L_system::turtle_params &){});
+        float sign = r & 1 ? -1.0f : 1.0f;
+        start = clock::now();
+        tree->rebuildEdited([=](L_system::turtle_params &p){ p.radius += 0.01f * sign; });
+        samples[PHASE_RADIUS].push_back(elapsedMs(start));
+
+        start = clock::now();
+        tree->rebuildEdited([=](L_system::turtle_params &p){ p.angle += 1.0f * sign; });
+        samples[PHASE_ANGLE].push_back(elapsedMs(start));
+
+        if (r + 1 == repeats){
+          result.symbols = tree->getAxiomSize();
+          result.vertices = vertices.size();
+          result.treeBytes = tree->memoryBytes();
+        }
+      }
+
+      result.grammar = L_system_tool::baseName(file);
+      result.depth = depth;
+      result.stochastic = stochastic;
+      result.peakBytes = peakResidentBytes();
+      for (int i = 0; i != NUM_PHASES; ++i){
+        result.phases[i] = summarise(samples[i]);
+      }
+      return true;
+    }
+
+    /// writes the results, one case to a line so compareBaseline() and diff can take them apart
+    bool writeResults(const char *path){
+      FILE *file = fopen(path, "w");
+      if (!file) return false;
+      fprintf(file, "{\"version\":1,\"repeats\":%d,\"threads\":%d,\"packed\":%s,\"peakBytes\":%llu,\"results\":[\n",
+        repeats, threadCount, isPacked ? "true" : "false", (unsigned long long)peakResidentBytes());
+      for (int i = 0; i != results.size(); ++i){
+        const bench_result &r = results[i];
+        fprintf(file, "{\"grammar\":\"%s\",\"depth\":%d,\"mode\":\"%s\",\"symbols\":%llu,\"vertices\":%llu,\"treeBytes\":%llu,\"peakBytes\":%llu",
+          r.grammar.c_str(), r.depth, r.stochastic ? "stochastic" : "deterministic", (unsigned long long)r.symbols,
+          (unsigned long long)r.vertices, (unsigned long long)r.treeBytes, (unsigned long long)r.peakBytes);
+        for (int p = 0; p != NUM_PHASES; ++p){
+          const bench_stats &s = r.phases[p];
+          // derivation makes symbols, the rest make vertices
+          double perSecond = s.medianMs > 0 ? (p == PHASE_DERIVE ? r.symbols : r.vertices) / (s.medianMs / 1000) : 0;
+          fprintf(file, ",\"%s\":{\"medianMs\":%.4f,\"minMs\":%.4f,\"p90Ms\":%.4f,\"p99Ms\":%.4f,\"maxMs\":%.4f,\"%s\":%.0f}",
+            phaseName(p), s.medianMs, s.minMs, s.p90Ms, s.p99Ms, s.maxMs, p == PHASE_DERIVE ? "symbolsPerSecond" : "verticesPerSecond", perSecond);
+        }
+        fprintf(file, "}%s\n", i + 1 != results.size() ? "," : "");
+      }
+      fprintf(file, "]}\n");
+      return fclose(file) == 0;
+    }
+
+    /// finds a case's median for a phase in a results file written by writeResults(), returns false if it is not there
+    static bool findBaseline(dynarray<string> &lines, const bench_result &r, int phase, double &medianMs){
+      string key;
+      key.format("{\"grammar\":\"%s\",\"depth\":%d,\"mode\":\"%s\",", r.grammar.c_str(), r.depth, r.stochastic ? "stochastic" : "deterministic");
+      string field;
+      field.format("\"%s\":{\"medianMs\":", phaseName(phase));
+      for (int i = 0; i != lines.size(); ++i){
+        if (strncmp(lines[i].c_str(), key.c_str(), key.size())) continue;
+        const char *p = strstr(lines[i].c_str(), field.c_str());
+        return p && sscanf(p + field.size(), "%lf", &medianMs) == 1;
+      }
+      return false;
+    }
+
+    /// compares every median with the baseline's, prints the ratios and returns the number of regressions
+    int compareBaseline(const char *path){
+      FILE *file = fopen(path, "r");
+      if (!file){
+        printf("could not read the baseline %s\n", path);
+        return 1;
+      }
+      dynarray<string> lines;
+      char buffer[4096];
+      while (fgets(buffer, sizeof(buffer), file)){
+        lines.push_back(string(buffer));
+      }
+      fclose(file);
+
+      int regressions = 0;
+      printf("grammar, depth, mode, phase, baseline ms, ms, ratio\n");
+      for (int i = 0; i != results.size(); ++i){
+        const bench_result &r = results[i];
+        for (int p = 0; p != NUM_PHASES; ++p){
+          double base;
+          if (!findBaseline(lines, r, p, base)) continue;
+          double now = r.phases[p].medianMs;
+          bool regressed = now > base * (1 + threshold / 100) && now - base > noiseFloorMs();
+          regressions += regressed;
+          printf("%s, %d, %s, %s, %.3f, %.3f, %.2f%s\n", r.grammar.c_str(), r.depth, r.stochastic ? "stochastic" : "deterministic",
+            phaseName(p), base, now, base > 0 ? now / base : 0.0, regressed ? " REGRESSION" : "");
+        }
+      }
+      printf("%d regressions over %.0f%%\n", regressions, threshold);
+      return regressions;
+    }
+
+  public:
+    L_system_bench() :
+      outputPath("lsystems_bench.json"),
+      threshold(10),
+      repeats(9),
+      threadCount(1),
+      isPacked(false),
+      ruleSamples(0),
+      iterationDepth(0),
+      geometrySegments(0),
+      copyingDepth(0),
+      cacheGeneration(-1),
+      reloadGeneration(-1),
+      modesGeneration(-1),
+      parserRules(0)
+    {
+      L_system_tool::parseList("2-6", depths);
+      modes[0] = modes[1] = true;
+    }
+
+    /// reads the options and grammar files, prints the usage and returns false if they make no sense
+    bool parseArgs(int argc, char **argv){
+      for (int i = 1; i < argc; ++i){
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-d") && hasValue){
+          if (!L_system_tool::parseList(argv[++i], depths)) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-r") && hasValue){
+          repeats = atoi(argv[++i]);
+          if (repeats < 1) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-j") && hasValue){
+          threadCount = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "-m") && hasValue){
+          const char *mode = argv[++i];
+          modes[0] = strchr(mode, 'd') != 0;
+          modes[1] = strchr(mode, 's') != 0;
+          if (!modes[0] && !modes[1]) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-p")){
+          isPacked = true;
+        }
+        else if (!strcmp(arg, "-o") && hasValue){
+          outputPath = argv[++i];
+        }
+        else if (!strcmp(arg, "-b") && hasValue){
+          baselinePath = argv[++i];
+        }
+        else if (!strcmp(arg, "-t") && hasValue){
+          threshold = atof(argv[++i]);
+        }
+        else if (!strcmp(arg, "-w") && hasValue){
+          ruleSamples = atoi(argv[++i]);
+          if (ruleSamples < 1) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-i") && hasValue){
+          iterationDepth = atoi(argv[++i]);
+          if (iterationDepth < 1) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-g") && hasValue){
+          geometrySegments = atoi(argv[++i]);
+          if (geometrySegments < 1) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-n") && hasValue){
+          copyingDepth = atoi(argv[++i]);
+          if (copyingDepth < 1) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-c") && hasValue){
+          cacheGeneration = atoi(argv[++i]);
+          if (cacheGeneration < 0) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-e") && hasValue){
+          reloadGeneration = atoi(argv[++i]);
+          if (reloadGeneration < 0) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-s") && hasValue){
+          modesGeneration = atoi(argv[++i]);
+          if (modesGeneration < 0) return usage(argv[0]);
+        }
+        else if (!strcmp(arg, "-l") && hasValue){
+          parserRules = atoi(argv[++i]);
+          if (parserRules < 1) return usage(argv[0]);
+        }
+        else if (arg[0] == '-'){
+          return usage(argv[0]);
+        }
+        else{
+          files.push_back(string(arg));
+        }
+      }
+      if (!files.size()){
+        for (int i = 1; i <= 9; ++i){
+          string path;
+          path.format("assets/Lsystems/Tree%d.txt", i);
+          files.push_back(path);
+        }
+      }
+      return true;
+    }
+
+    bool usage(const char *program){
+      printf("usage: %s [-d depths] [-r repeats] [-j threads] [-m ds] [-p] [-o file] [-b baseline] [-t percent] [grammar files...]\n", program);
+      printf("       %s [-w samples] [-i depth] [-g segments] [-n depth] [-c generation] [-e generation] [-s generation] [-l rules] [grammar files...]\n", program);
+      printf("  depths are lists and ranges, e.g. -d 3,5-7\n");
+      return false;
+    }
+
+    /// runs the checks asked for on every grammar, prints what each finds and returns the process exit code
+    int runChecks(){
+      int failures = 0;
+      if (parserRules){
+        ref<L_system> tree = new L_system();
+        if (!tree->benchmarkParser(parserRules, PARSER_RULE_LENGTH)) failures++;
+      }
+      for (int f = 0; f != files.size() && (ruleSamples || iterationDepth || geometrySegments || copyingDepth || cacheGeneration >= 0 || reloadGeneration >= 0 || modesGeneration >= 0); ++f){
+        ref<L_system> tree = new L_system();
+        tree->setQuiet(true);
+        tree->setThreadCount(threadCount);
+        if (!tree->loadFile(files[f])){
+          failures++;
+          continue;
+        }
+        printf("%s\n", files[f].c_str());
+        if (ruleSamples && tree->hasStochasticRules() && !tree->testRuleDistribution(ruleSamples)) failures++;
+        if (iterationDepth && !tree->benchmarkIteration(iterationDepth)) failures++;
+        if (geometrySegments && !tree->benchmarkGeometry(geometrySegments)) failures++;
+        if (copyingDepth && !tree->benchmarkSubtreeCopying(copyingDepth)) failures++;
+        if (cacheGeneration >= 0 && !tree->testCache(cacheDir(), cacheGeneration)) failures++;
+        if (reloadGeneration >= 0 && !tree->testReload(reloadPath(), reloadGeneration)) failures++;
+        if (modesGeneration >= 0 && !tree->testModes(modesGeneration)) failures++;
+      }
+      printf("%d checks failed\n", failures);
+      return failures ? 1 : 0;
+    }
+
+    /// times every case, writes the results and returns the process exit code
+    int run(){
+      if (ruleSamples || iterationDepth || geometrySegments || copyingDepth || cacheGeneration >= 0 || reloadGeneration >= 0 || modesGeneration >= 0 || parserRules) return runChecks();
+      int failures = 0;
+      results.resize(0);
+      printf("grammar, depth, mode, symbols, derive ms, interpret ms, radius ms, angle ms\n");
+      for (int f = 0; f != files.size(); ++f){
+        for (int d = 0; d != depths.size(); ++d){
+          for (int m = 0; m != 2; ++m){
+            if (!modes[m]) continue;
+            bench_result result;
+            if (!runCase(files[f], depths[d], m == 1, result)){
+              failures++;
+              continue;
+            }
+            results.push_back(result);
+            printf("%s, %d, %s, %llu, %.3f, %.3f, %.3f, %.3f\n", result.grammar.c_str(), result.depth, m ? "stochastic" : "deterministic",
+              (unsigned long long)result.symbols, result.phases[PHASE_DERIVE].medianMs, result.phases[PHASE_INTERPRET].medianMs,
+              result.phases[PHASE_RADIUS].medianMs, result.phases[PHASE_ANGLE].medianMs);
+          }
+        }
+      }
+
+      if (!writeResults(outputPath)){
+        printf("could not write %s\n", outputPath.c_str());
+        return 1;
+      }
+      printf("results written to %s\n", outputPath.c_str());
+      if (baselinePath.size() && compareBaseline(baselinePath)) return 1;
+      return failures ? 1 : 0;
+    }
+  };
+}
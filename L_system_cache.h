@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// L - System cache file format
+//
+// A cache file holds one tree: the compiled rules, the derived string of each
+// generation up to the cached one and that generation's vertex and index buffers.
+// Everything is little endian and every section starts on a 16 byte boundary,
+// so a mapped file can be uploaded straight from its pages.
+//
+//   header
+//   symbol table    256 symbol entries
+//   successor pool  poolSize chars
+//   alternatives    numAlternatives weighted successors, each { offset, length, threshold }
+//   string table    numStrings { offset, size } pairs, size 0 if that generation was not kept
+//   strings
+//   vertices        numVertices myVertex
+//   indices         numIndices uint32_t
+//
+
+#ifndef _WIN32
+  #include <errno.h>
+  #include <sys/stat.h>
+#endif
+
+namespace octet{
+  /// the start of a cache file, offsets are from the start of the file
+  struct L_system_cache_header{
+    enum { VERSION = 2, ALIGNMENT = 16 };
+
+    char magic[4];              // "LSYC"
+    uint32_t version;
+    uint64_t key;               // L_system::cacheKey() of the tree
+    uint64_t fileSize;
+    uint32_t vertexSize;        // the layouts the file was written with, a mismatch rejects the file
+    uint32_t symbolEntrySize;
+
+    // the tree, enough to carry on from the cached generation without the grammar file
+    uint32_t generation;
+    uint32_t startingAxiom;
+    float angle;
+    float translate[3];
+    float radius;
+    uint32_t sides;
+    uint32_t stochastic;
+    uint32_t seed;
+
+    uint64_t symbolsOffset;
+    uint64_t poolOffset;
+    uint32_t poolSize;
+    uint32_t numStrings;
+    uint64_t stringsOffset;
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+    uint32_t numVertices;
+    uint32_t numIndices;
+    uint64_t alternativesOffset;
+    uint32_t numAlternatives;
+    uint32_t padding;
+
+    /// true if size bytes at offset are inside the file
+    bool contains(uint64_t offset, uint64_t size) const{
+      return offset <= fileSize && size <= fileSize - offset;
+    }
+  };
+
+  /// where a generation's string is in the file
+  struct L_system_cache_string{
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  /// the directory cache files are written to
+  struct L_system_cache_dir{
+    /// makes the directory if it is not there yet, returns false if it can not be made
+    static bool make(const char *path){
+    #ifdef _WIN32
+      return CreateDirectoryA(path, 0) || GetLastError() == ERROR_ALREADY_EXISTS;
+    #else
+      return mkdir(path, 0777) == 0 || errno == EEXIST;
+    #endif
+    }
+  };
+
+  /// 64 bit FNV-1a, used to key cache files
+  struct L_system_cache_hash{
+    uint64_t value;
+
+    L_system_cache_hash() : value(14695981039346656037ull){
+    }
+
+    void add(const void *data, size_t size){
+      const uint8_t *bytes = (const uint8_t *)data;
+      for (size_t i = 0; i != size; ++i){
+        value = (value ^ bytes[i]) * 1099511628211ull;
+      }
+    }
+
+    template <class value_t> void add(const value_t &v){
+      add(&v, sizeof(v));
+    }
+  };
+}
@@ -0,0 +1,336 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// Forest of L - System trees
+//
+// A forest scatters many trees from a few grammars. Each grammar is derived
+// once for each depth and the string is shared by every tree grown from it.
+// Each distinct shape (grammar, depth, seed and angle) is interpreted once on a
+// pool of threads, and the placed trees are merged into a few large meshes on
+// one scene node, so thousands of trees are a handful of draw calls with no
+// scene_node or mesh of their own.
+// Include after L_system.h.
+//
+
+namespace octet {
+  /// Builds and draws many trees as a few merged meshes
+  class L_system_forest : public resource {
+  public:
+    typedef L_system::myVertex myVertex;
+
+    /// one tree of the forest
+    struct forest_tree {
+      int grammar;        // index returned by addGrammar()
+      int depth;
+      unsigned seed;      // only changes the shape in the stochastic mode or of a grammar with weighted rules
+      float angle;        // turning angle in degrees, 0 keeps the grammar's
+      vec3 position;
+      float heading;      // degrees about y
+      float scale;
+    };
+
+  private:
+    /// most vertices merged into one mesh, a tree is never split between meshes
+    enum { BATCH_VERTICES = 1 << 22 };
+
+    /// a grammar derived to one depth, its string is shared by every tree grown from it
+    struct forest_source {
+      int grammar;
+      int depth;
+      ref<L_system> tree;
+    };
+
+    /// a distinct tree, interpreted once however many trees use it
+    struct forest_shape : public resource {
+      int source;
+      unsigned seed;
+      float angle;
+      dynarray<myVertex> vertices;
+      dynarray<uint32_t> indices;
+    };
+
+    /// a merged mesh of a run of trees
+    struct forest_batch : public resource {
+      ref<mesh> geometry;
+      dynarray<myVertex> vertices;    // released once uploaded
+      dynarray<uint32_t> indices;
+      int numVertices;                // what geometry draws and has room for, kept so a rebuild that fits reuses its buffers
+      int numIndices;
+      int vertexCapacity;
+      int indexCapacity;
+
+      forest_batch() : numVertices(0), numIndices(0), vertexCapacity(-1), indexCapacity(-1) {
+      }
+    };
+
+    L_system_pool threadPool;       // kept between rebuilds and shared with the sources, so a rebuild starts no threads
+    dynarray<string> grammars;
+    dynarray<bool> grammarSeeded;   // the grammar has weighted rules, so its trees' seeds change their strings
+    dynarray<forest_tree> trees;
+    dynarray<int> treeShapes;       // the shape each tree is a copy of
+    dynarray<int> treeBatches;      // the batch each tree is merged into
+    dynarray<int> vertexOffsets;    // where each tree starts in its batch
+    dynarray<int> indexOffsets;
+    dynarray<forest_source> sources;
+    dynarray<ref<forest_shape> > shapes;
+    dynarray<ref<forest_batch> > batches;
+    ref<scene_node> node;
+    int threadCount;
+    bool isStochastic;
+
+    int getThreads(int jobs){
+      int threads = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+      if (threads > jobs) threads = jobs;
+      return threads < 1 ? 1 : threads;
+    }
+
+    /// runs job(i, thread) for i in [0, count) on the forest's pool, thread is below getThreads(count)
+    template <class job_t> void runJobs(int count, job_t job){
+      threadPool.run(count, getThreads(count), job);
+    }
+
+    /// the shape a tree is drawn with, equal keys are the same shape
+    /// the seed only matters in the stochastic mode or with weighted rules, so deterministic trees of a grammar and depth share a shape
+    bool shapeLess(int a, int b) const{
+      const forest_tree &x = trees[a], &y = trees[b];
+      if (x.grammar != y.grammar) return x.grammar < y.grammar;
+      if (x.depth != y.depth) return x.depth < y.depth;
+      if ((isStochastic || grammarSeeded[x.grammar]) && x.seed != y.seed) return x.seed < y.seed;
+      return x.angle < y.angle;
+    }
+
+    /// derives each grammar and depth the trees use once
+    bool deriveSources(){
+      sources.reset();
+      treeShapes.resize(trees.size());
+      grammarSeeded.resize(grammars.size());
+      for (int g = 0; g != grammars.size(); ++g){
+        grammarSeeded[g] = false;
+      }
+      for (int i = 0; i != trees.size(); ++i){
+        const forest_tree &t = trees[i];
+        int s = 0;
+        while (s != sources.size() && (sources[s].grammar != t.grammar || sources[s].depth != t.depth)) ++s;
+        if (s == sources.size()){
+          forest_source source = { t.grammar, t.depth, new L_system() };
+          source.tree->setQuiet(true);
+          source.tree->setThreadCount(threadCount);
+          source.tree->setThreadPool(&threadPool);
+          if (t.grammar < 0 || t.grammar >= grammars.size() || !source.tree->loadFile(grammars[t.grammar])) return false;
+          source.tree->setStochastic(isStochastic);
+          source.tree->iteration(t.depth);
+          if (source.tree->hasStochasticRules()) grammarSeeded[t.grammar] = true;
+          sources.push_back(source);
+        }
+        // the source for now, replaced by the shape once the trees are grouped
+        treeShapes[i] = s;
+      }
+      return true;
+    }
+
+    /// groups the trees by shape and interprets each shape once, each thread keeps one tree per source sharing its string
+    void buildShapes(){
+      dynarray<int> order;
+      order.resize(trees.size());
+      for (int i = 0; i != trees.size(); ++i){
+        order[i] = i;
+      }
+      std::sort(order.begin(), order.end(), [this](int a, int b){ return shapeLess(a, b); });
+
+      shapes.reset();
+      for (int i = 0; i != order.size(); ++i){
+        int t = order[i];
+        if (i == 0 || shapeLess(order[i - 1], t)){
+          forest_shape *shape = new forest_shape();
+          shape->source = treeShapes[t];
+          shape->seed = trees[t].seed;
+          shape->angle = trees[t].angle;
+          shapes.push_back(shape);
+        }
+        treeShapes[t] = shapes.size() - 1;
+      }
+
+      // thread i's trees are workerTrees[i * sources + source]
+      dynarray<ref<L_system> > workerTrees;
+      workerTrees.resize(getThreads(shapes.size()) * sources.size());
+      runJobs(shapes.size(), [&](int s, int thread){
+        forest_shape &shape = *shapes[s];
+        ref<L_system> &tree = workerTrees[thread * sources.size() + shape.source];
+        if (!tree){
+          tree = new L_system();
+          tree->useGeneration(*sources[shape.source].tree);
+          tree->setThreadCount(1);
+        }
+        tree->setSeed(shape.seed);
+        tree->setAngle(shape.angle != 0 ? shape.angle : sources[shape.source].tree->getAngle());
+        tree->buildGeometry(shape.vertices, shape.indices);
+      });
+    }
+
+    /// packs the trees into batches in order and moves each copy of its shape into place, the trees in parallel
+    /// the batches and their meshes are kept from the last build
+    void mergeBatches(){
+      treeBatches.resize(trees.size());
+      vertexOffsets.resize(trees.size());
+      indexOffsets.resize(trees.size());
+
+      int b = 0, vertices = 0, indices = 0;
+      for (int i = 0; i != trees.size(); ++i){
+        const forest_shape &shape = *shapes[treeShapes[i]];
+        if (vertices && vertices + shape.vertices.size() > BATCH_VERTICES){
+          sizeBatch(b++, vertices, indices);
+          vertices = indices = 0;
+        }
+        treeBatches[i] = b;
+        vertexOffsets[i] = vertices;
+        indexOffsets[i] = indices;
+        vertices += shape.vertices.size();
+        indices += shape.indices.size();
+      }
+      if (trees.size()) sizeBatch(b++, vertices, indices);
+      // batches are never dropped so mesh instances drawing them stay valid, a smaller forest leaves them empty
+      for (; b < batches.size(); ++b){
+        sizeBatch(b, 0, 0);
+      }
+
+      runJobs(trees.size(), [&](int i, int){
+        const forest_tree &t = trees[i];
+        const forest_shape &shape = *shapes[treeShapes[i]];
+        forest_batch &batch = *batches[treeBatches[i]];
+        float c = cosf(t.heading * (3.14159265f / 180)) * t.scale, s = sinf(t.heading * (3.14159265f / 180)) * t.scale;
+
+        const myVertex *src = shape.vertices.data();
+        myVertex *dest = batch.vertices.data() + vertexOffsets[i];
+        for (int v = 0; v != shape.vertices.size(); ++v){
+          const float *p = (const float *)&src[v].pos;
+          dest[v].pos = vec3p(t.position[0] + c * p[0] + s * p[2], t.position[1] + t.scale * p[1], t.position[2] - s * p[0] + c * p[2]);
+          dest[v].colour = src[v].colour;
+        }
+
+        uint32_t base = (uint32_t)vertexOffsets[i];
+        const uint32_t *in = shape.indices.data();
+        uint32_t *out = batch.indices.data() + indexOffsets[i];
+        for (int n = 0; n != shape.indices.size(); ++n){
+          out[n] = in[n] + base;
+        }
+      });
+    }
+
+    /// makes room in batch b, adding it if it is new
+    void sizeBatch(int b, int vertices, int indices){
+      if (b == batches.size()) batches.push_back(new forest_batch());
+      batches[b]->vertices.resize(vertices);
+      batches[b]->indices.resize(indices);
+    }
+
+  public:
+    L_system_forest() : threadCount(0), isStochastic(true) {
+      node = new scene_node();
+    }
+
+    /// adds a grammar file the trees can be grown from, returns its index
+    int addGrammar(const char *path){
+      grammars.push_back(string(path));
+      return grammars.size() - 1;
+    }
+
+    /// jitters the shapes by each tree's seed, without it every tree of a grammar and depth is the same shape
+    void setStochastic(bool stochastic){
+      isStochastic = stochastic;
+    }
+
+    /// sets the threads used to derive and interpret, 0 uses every hardware thread
+    void setThreadCount(int count){
+      threadCount = count < 0 ? 0 : count;
+    }
+
+    void addTree(const forest_tree &tree){
+      trees.push_back(tree);
+    }
+
+    void clearTrees(){
+      trees.resize(0);
+    }
+
+    /// adds count trees at random in a disc of the given radius, each from a random grammar
+    /// seeds are drawn from 1 to variants, so there are at most variants shapes of each grammar, and at least one
+    void scatter(int count, float radius, int depth, int variants, unsigned randomSeed){
+      if (variants < 1) variants = 1;
+      random rng(randomSeed);
+      for (int i = 0; i != count; ++i){
+        float r = radius * sqrtf(rng.get(0.0f, 1.0f)), theta = rng.get(0.0f, 2 * 3.14159265f);
+        int grammar = (int)rng.get(0.0f, (float)grammars.size());
+        unsigned variant = (unsigned)rng.get(0.0f, (float)variants);
+        forest_tree tree = {
+          grammar < (int)grammars.size() ? grammar : (int)grammars.size() - 1, depth, 1 + variant % variants, 0,
+          vec3(r * cosf(theta), 0, r * sinf(theta)), rng.get(0.0f, 360.0f), rng.get(0.8f, 1.2f)
+        };
+        trees.push_back(tree);
+      }
+    }
+
+    /// derives, interprets and merges every tree without touching OpenGL, returns false if a grammar would not load
+    bool build(){
+      if (!deriveSources()){
+        batches.reset();
+        return false;
+      }
+      buildShapes();
+      mergeBatches();
+      return true;
+    }
+
+    /// copies the merged trees into the batch meshes and releases the CPU copies
+    /// the GL buffers are only reallocated when a batch outgrows them, and a batch left empty is just drawn with no triangles
+    void upload(){
+      for (int b = 0; b != batches.size(); ++b){
+        forest_batch &batch = *batches[b];
+        int vertices = batch.vertices.size(), indices = batch.indices.size();
+        if (!batch.geometry) batch.geometry = new mesh();
+        if (vertices > batch.vertexCapacity || indices > batch.indexCapacity){
+          // the same slack as the tree's own mesh, so a slightly larger forest fits
+          batch.vertexCapacity = vertices + vertices / 4;
+          batch.indexCapacity = indices + indices / 4;
+          L_system::allocateMesh(batch.geometry, vertices, indices, batch.vertexCapacity, batch.indexCapacity);
+        }
+        else if (vertices != batch.numVertices || indices != batch.numIndices){
+          batch.geometry->set_params(sizeof(myVertex), indices, vertices, GL_TRIANGLES, GL_UNSIGNED_INT);
+        }
+        batch.numVertices = vertices;
+        batch.numIndices = indices;
+
+        if (vertices) L_system::copyToMesh(batch.geometry, batch.vertices.data(), batch.indices.data(), vertices, indices);
+        batch.vertices.reset();
+        batch.indices.reset();
+      }
+    }
+
+    /// the node every batch is drawn with
+    scene_node *getNode(){
+      return node;
+    }
+
+    int getBatchCount() const{
+      return batches.size();
+    }
+
+    mesh *getBatchMesh(int i){
+      return batches[i]->geometry;
+    }
+
+    /// returns the number of distinct shapes the last build interpreted
+    int getShapeCount() const{
+      return shapes.size();
+    }
+
+    /// returns the vertices in the merged trees, before upload() releases them
+    uint64_t getVertexCount() const{
+      uint64_t count = 0;
+      for (int b = 0; b != batches.size(); ++b){
+        count += batches[b]->vertices.size();
+      }
+      return count;
+    }
+  };
+}
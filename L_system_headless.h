@@ -0,0 +1,437 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// The part of octet the L - System headers use, without OpenGL or a window
+//
+// L_system.h includes this instead of octet.h when LS_HEADLESS is defined, so the
+// command line tools build from this directory on their own. The classes keep
+// octet's names and behaviour for what the L - System code calls: dynarray keeps
+// its storage on resize, meshes keep their vertices and indices in memory rather
+// than in buffer objects and scene nodes only hold their transforms.
+//
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <utility>
+
+typedef unsigned GLenum;
+enum {
+  GL_LINES = 0x0001,
+  GL_TRIANGLES = 0x0004,
+  GL_FRONT_AND_BACK = 0x0408,
+  GL_UNSIGNED_BYTE = 0x1401,
+  GL_UNSIGNED_INT = 0x1405,
+  GL_FLOAT = 0x1406,
+  GL_LINE = 0x1B01,
+  GL_TRUE = 1,
+};
+
+namespace octet {
+  enum { attribute_pos, attribute_normal, attribute_color, attribute_uv };
+
+  /// growable array, resize(0) keeps the storage and reset() frees it
+  template <class item_t> class dynarray {
+    item_t *data_;
+    unsigned size_;
+    unsigned capacity_;
+
+    void grow(unsigned min_capacity){
+      unsigned new_capacity = capacity_ ? capacity_ : 4;
+      while (new_capacity < min_capacity) new_capacity = new_capacity * 2 > new_capacity ? new_capacity * 2 : min_capacity;
+      reserve(new_capacity);
+    }
+
+  public:
+    typedef item_t *iterator;
+    typedef const item_t *const_iterator;
+
+    dynarray() : data_(0), size_(0), capacity_(0) {}
+    explicit dynarray(unsigned size) : data_(0), size_(0), capacity_(0) { resize(size); }
+    dynarray(const dynarray &rhs) : data_(0), size_(0), capacity_(0) { *this = rhs; }
+    ~dynarray() { reset(); }
+
+    dynarray &operator=(const dynarray &rhs){
+      if (this != &rhs){
+        resize(0);
+        reserve(rhs.size_);
+        for (unsigned i = 0; i != rhs.size_; ++i) new (&data_[i]) item_t(rhs.data_[i]);
+        size_ = rhs.size_;
+      }
+      return *this;
+    }
+
+    /// new items are default initialised, so plain data is left as it was
+    void resize(unsigned new_size){
+      if (new_size > capacity_) reserve(new_size);
+      for (unsigned i = new_size; i < size_; ++i) data_[i].~item_t();
+      for (unsigned i = size_; i < new_size; ++i) new (&data_[i]) item_t;
+      size_ = new_size;
+    }
+
+    void reserve(unsigned new_capacity){
+      if (new_capacity <= capacity_) return;
+      item_t *new_data = (item_t*)malloc(sizeof(item_t) * (size_t)new_capacity);
+      if (!new_data) throw std::bad_alloc();
+      for (unsigned i = 0; i != size_; ++i){
+        new (&new_data[i]) item_t(std::move(data_[i]));
+        data_[i].~item_t();
+      }
+      free(data_);
+      data_ = new_data;
+      capacity_ = new_capacity;
+    }
+
+    void reset(){
+      resize(0);
+      free(data_);
+      data_ = 0;
+      capacity_ = 0;
+    }
+
+    void push_back(const item_t &item){
+      if (size_ == capacity_){
+        item_t copy(item);
+        grow(size_ + 1);
+        new (&data_[size_++]) item_t(std::move(copy));
+      } else {
+        new (&data_[size_++]) item_t(item);
+      }
+    }
+
+    void pop_back() { data_[--size_].~item_t(); }
+
+    unsigned size() const { return size_; }
+    unsigned capacity() const { return capacity_; }
+    bool is_empty() const { return size_ == 0; }
+    item_t *data() { return data_; }
+    const item_t *data() const { return data_; }
+    item_t &back() { return data_[size_ - 1]; }
+    const item_t &back() const { return data_[size_ - 1]; }
+    item_t &operator[](int i) { return data_[i]; }
+    const item_t &operator[](int i) const { return data_[i]; }
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+  };
+
+  /// zero terminated string that owns its characters
+  class string {
+    dynarray<char> chars;
+
+  public:
+    string() { set("", 0); }
+    string(const char *text) { set(text, (int)strlen(text)); }
+    string(const char *text, int length) { set(text, length); }
+
+    void set(const char *text, int length){
+      chars.resize(0);
+      chars.reserve(length + 1);
+      chars.resize(length + 1);
+      memcpy(chars.data(), text, length);
+      chars[length] = 0;
+    }
+
+    string &operator=(const char *text) { set(text, (int)strlen(text)); return *this; }
+
+    int size() const { return (int)chars.size() - 1; }
+    const char *c_str() const { return chars.data(); }
+    operator const char *() const { return chars.data(); }
+
+    /// the position of the first match, or -1
+    int find(const char *text) const {
+      const char *p = strstr(c_str(), text);
+      return p ? (int)(p - c_str()) : -1;
+    }
+
+    string &format(const char *fmt, ...){
+      va_list args;
+      va_start(args, fmt);
+      int length = vsnprintf(0, 0, fmt, args);
+      va_end(args);
+      chars.resize(length + 1);
+      va_start(args, fmt);
+      vsnprintf(chars.data(), length + 1, fmt, args);
+      va_end(args);
+      return *this;
+    }
+
+    bool operator==(const char *rhs) const { return !strcmp(c_str(), rhs); }
+    bool operator!=(const char *rhs) const { return strcmp(c_str(), rhs) != 0; }
+  };
+
+  class vec3 {
+    float v[3];
+  public:
+    vec3() { v[0] = v[1] = v[2] = 0; }
+    vec3(float xyz) { v[0] = v[1] = v[2] = xyz; }
+    vec3(float x, float y, float z) { v[0] = x; v[1] = y; v[2] = z; }
+
+    float &operator[](int i) { return v[i]; }
+    const float &operator[](int i) const { return v[i]; }
+    float x() const { return v[0]; }
+    float y() const { return v[1]; }
+    float z() const { return v[2]; }
+
+    vec3 operator+(const vec3 &r) const { return vec3(v[0] + r.v[0], v[1] + r.v[1], v[2] + r.v[2]); }
+    vec3 operator-(const vec3 &r) const { return vec3(v[0] - r.v[0], v[1] - r.v[1], v[2] - r.v[2]); }
+    vec3 operator*(const vec3 &r) const { return vec3(v[0] * r.v[0], v[1] * r.v[1], v[2] * r.v[2]); }
+    vec3 operator-() const { return vec3(-v[0], -v[1], -v[2]); }
+    vec3 operator*(float r) const { return vec3(v[0] * r, v[1] * r, v[2] * r); }
+    vec3 operator/(float r) const { return *this * (1.0f / r); }
+    vec3 &operator+=(const vec3 &r) { return *this = *this + r; }
+    vec3 &operator-=(const vec3 &r) { return *this = *this - r; }
+    vec3 &operator*=(float r) { return *this = *this * r; }
+    bool operator==(const vec3 &r) const { return v[0] == r.v[0] && v[1] == r.v[1] && v[2] == r.v[2]; }
+    bool operator!=(const vec3 &r) const { return !(*this == r); }
+
+    float dot(const vec3 &r) const { return v[0] * r.v[0] + v[1] * r.v[1] + v[2] * r.v[2]; }
+    float squared() const { return dot(*this); }
+    float length() const { return sqrtf(squared()); }
+    vec3 normalize() const { return *this * (1.0f / length()); }
+    vec3 cross(const vec3 &r) const {
+      return vec3(v[1] * r.v[2] - v[2] * r.v[1], v[2] * r.v[0] - v[0] * r.v[2], v[0] * r.v[1] - v[1] * r.v[0]);
+    }
+  };
+
+  inline vec3 operator*(float l, const vec3 &r) { return r * l; }
+
+  /// packed vec3 for vertex formats
+  struct vec3p {
+    float x, y, z;
+    vec3p() {}
+    vec3p(float x, float y, float z) : x(x), y(y), z(z) {}
+    vec3p(const vec3 &v) : x(v[0]), y(v[1]), z(v[2]) {}
+    operator vec3() const { return vec3(x, y, z); }
+  };
+
+  class vec4 {
+    float v[4];
+  public:
+    vec4() { v[0] = v[1] = v[2] = v[3] = 0; }
+    vec4(float x, float y, float z, float w) { v[0] = x; v[1] = y; v[2] = z; v[3] = w; }
+    vec4(const vec3 &xyz, float w) { v[0] = xyz[0]; v[1] = xyz[1]; v[2] = xyz[2]; v[3] = w; }
+
+    float &operator[](int i) { return v[i]; }
+    const float &operator[](int i) const { return v[i]; }
+    vec3 xyz() const { return vec3(v[0], v[1], v[2]); }
+
+    vec4 operator+(const vec4 &r) const { return vec4(v[0] + r.v[0], v[1] + r.v[1], v[2] + r.v[2], v[3] + r.v[3]); }
+    vec4 operator-(const vec4 &r) const { return vec4(v[0] - r.v[0], v[1] - r.v[1], v[2] - r.v[2], v[3] - r.v[3]); }
+    vec4 operator*(float r) const { return vec4(v[0] * r, v[1] * r, v[2] * r, v[3] * r); }
+    vec4 &operator+=(const vec4 &r) { return *this = *this + r; }
+  };
+
+  /// row vector matrix, as in octet a point is transformed by p * m and the translation is row 3
+  class mat4t {
+    vec4 v[4];
+
+    /// rotates rows i and j by angle degrees
+    mat4t &rotate(float angle, int i, int j){
+      float radians = angle * (3.14159265f / 180);
+      float c = cosf(radians), s = sinf(radians);
+      vec4 ri = v[i], rj = v[j];
+      v[i] = ri * c + rj * s;
+      v[j] = rj * c - ri * s;
+      return *this;
+    }
+
+  public:
+    mat4t() { loadIdentity(); }
+    mat4t(const vec4 &x, const vec4 &y, const vec4 &z, const vec4 &w) { v[0] = x; v[1] = y; v[2] = z; v[3] = w; }
+
+    mat4t &loadIdentity(){
+      v[0] = vec4(1, 0, 0, 0); v[1] = vec4(0, 1, 0, 0); v[2] = vec4(0, 0, 1, 0); v[3] = vec4(0, 0, 0, 1);
+      return *this;
+    }
+
+    vec4 &operator[](int i) { return v[i]; }
+    const vec4 &operator[](int i) const { return v[i]; }
+
+    mat4t &translate(const vec3 &t) { v[3] += v[0] * t[0] + v[1] * t[1] + v[2] * t[2]; return *this; }
+    mat4t &translate(float x, float y, float z) { return translate(vec3(x, y, z)); }
+    mat4t &rotateX(float angle) { return rotate(angle, 1, 2); }
+    mat4t &rotateY(float angle) { return rotate(angle, 2, 0); }
+    mat4t &rotateZ(float angle) { return rotate(angle, 0, 1); }
+
+    /// the rotation and scale without the translation
+    mat4t xyz() const { return mat4t(v[0], v[1], v[2], vec4(0, 0, 0, 1)); }
+
+    mat4t operator*(const mat4t &r) const {
+      mat4t result;
+      for (int i = 0; i != 4; ++i){
+        result.v[i] = r.v[0] * v[i][0] + r.v[1] * v[i][1] + r.v[2] * v[i][2] + r.v[3] * v[i][3];
+      }
+      return result;
+    }
+  };
+
+  inline vec4 operator*(const vec4 &l, const mat4t &r) { return r[0] * l[0] + r[1] * l[1] + r[2] * l[2] + r[3] * l[3]; }
+  inline vec3 operator*(const vec3p &l, const mat4t &r) { return (vec4(l, 1) * r).xyz(); }
+
+  /// xor shift generator
+  class random {
+    unsigned seed;
+  public:
+    random(unsigned seed = 0x9bac7615) : seed(seed ? seed : 0x9bac7615) {}
+    void set_seed(unsigned value) { seed = value ? value : 0x9bac7615; }
+    unsigned get(){
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      return seed;
+    }
+    /// from min up to but not including max
+    float get(float min, float max) { return min + (max - min) * (get() >> 8) * (1.0f / 16777216); }
+    int get(int min, int max) { return min + (int)(get() % (unsigned)(max - min)); }
+  };
+
+  /// reference counted base class
+  class resource {
+    int ref_count;
+  public:
+    resource() : ref_count(0) {}
+    virtual ~resource() {}
+    void add_ref() { ref_count++; }
+    void release() { if (--ref_count == 0) delete this; }
+  };
+
+  template <class item_t> class ref {
+    item_t *ptr;
+  public:
+    ref() : ptr(0) {}
+    ref(item_t *p) : ptr(p) { if (ptr) ptr->add_ref(); }
+    ref(const ref &r) : ptr(r.ptr) { if (ptr) ptr->add_ref(); }
+    ~ref() { if (ptr) ptr->release(); }
+    ref &operator=(item_t *p){
+      if (p) p->add_ref();
+      if (ptr) ptr->release();
+      ptr = p;
+      return *this;
+    }
+    ref &operator=(const ref &r) { return *this = r.ptr; }
+    item_t *operator->() const { return ptr; }
+    operator item_t *() const { return ptr; }
+    item_t *get() const { return ptr; }
+  };
+
+  /// buffer in memory where octet would have a buffer object
+  class gl_resource : public resource {
+    dynarray<uint8_t> bytes;
+  public:
+    void allocate(GLenum, size_t size) { bytes.resize((unsigned)size); }
+    unsigned get_size() const { return bytes.size(); }
+
+    /// write only access to the buffer
+    class wolock {
+      uint8_t *ptr;
+    public:
+      wolock(gl_resource *res) : ptr(res->bytes.data()) {}
+      uint8_t *u8() { return ptr; }
+      uint32_t *u32() { return (uint32_t*)ptr; }
+      float *f32() { return (float*)ptr; }
+    };
+
+    /// read only access to the buffer
+    class rolock {
+      const uint8_t *ptr;
+    public:
+      rolock(gl_resource *res) : ptr(res->bytes.data()) {}
+      const uint8_t *u8() { return ptr; }
+      const uint32_t *u32() { return (const uint32_t*)ptr; }
+      const float *f32() { return (const float*)ptr; }
+    };
+  };
+
+  /// vertices and indices with the format octet would draw them in
+  class mesh : public resource {
+    ref<gl_resource> vertices;
+    ref<gl_resource> indices;
+    unsigned stride;
+    unsigned num_indices;
+    unsigned num_vertices;
+    GLenum mode;
+    GLenum index_type;
+
+  public:
+    mesh() : stride(0), num_indices(0), num_vertices(0), mode(GL_TRIANGLES), index_type(GL_UNSIGNED_INT) { init(); }
+
+    void init(){
+      vertices = new gl_resource();
+      indices = new gl_resource();
+      num_indices = num_vertices = 0;
+    }
+
+    void allocate(size_t vertex_size, size_t index_size, bool = true){
+      vertices->allocate(0, vertex_size);
+      indices->allocate(0, index_size);
+    }
+
+    void set_params(unsigned new_stride, unsigned new_num_indices, unsigned new_num_vertices, GLenum new_mode, GLenum new_index_type){
+      stride = new_stride;
+      num_indices = new_num_indices;
+      num_vertices = new_num_vertices;
+      mode = new_mode;
+      index_type = new_index_type;
+    }
+
+    void add_attribute(unsigned, unsigned, unsigned, unsigned, unsigned = 0) {}
+    void clear_attributes() {}
+
+    unsigned get_num_indices() const { return num_indices; }
+    unsigned get_num_vertices() const { return num_vertices; }
+    gl_resource *get_vertices() { return vertices; }
+    gl_resource *get_indices() { return indices; }
+  };
+
+  /// transform in a hierarchy
+  class scene_node : public resource {
+    mat4t nodeToParent;
+    dynarray<ref<scene_node> > children;
+    scene_node *parent;
+
+  public:
+    scene_node() : parent(0) {}
+    scene_node(const mat4t &transform, int = 0) : nodeToParent(transform), parent(0) {}
+
+    mat4t &access_nodeToParent() { return nodeToParent; }
+
+    void add_child(scene_node *child){
+      child->parent = this;
+      children.push_back(child);
+    }
+
+    int get_num_children() const { return children.size(); }
+    scene_node *get_child(int i) const { return children[i]; }
+
+    mat4t calcModelToWorld(){
+      mat4t result = nodeToParent;
+      for (scene_node *p = parent; p; p = p->parent) result = result * p->nodeToParent;
+      return result;
+    }
+  };
+
+  class app_utils {
+  public:
+    /// reads a whole file, leaves the buffer empty if it can not be read
+    static void get_url(dynarray<uint8_t> &buffer, const char *url){
+      buffer.resize(0);
+      FILE *file = fopen(url, "rb");
+      if (!file) return;
+      fseek(file, 0, SEEK_END);
+      long size = ftell(file);
+      fseek(file, 0, SEEK_SET);
+      if (size > 0){
+        buffer.resize((unsigned)size);
+        if (fread(buffer.data(), 1, (size_t)size, file) != (size_t)size) buffer.resize(0);
+      }
+      fclose(file);
+    }
+  };
+}
@@ -0,0 +1,794 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// L - System grammar reader
+//
+// A grammar file is a list of statements, each ending in ';'
+//   Message: any text;
+//   Alphabet: F, X, [, ], +, -;
+//   Axiom: X;
+//   Rules: 2;
+//   X = F[+X][-X]FX;
+//   F = FF;
+//   Y = {2} F[+Y]Y;
+//   Y = {1} F[-Y]Y;
+//   Angle: 25.7;
+//   Iterations: 5;
+// whitespace is ignored outside the message, so rules may be split over lines
+// a weight in braces makes a rule one of its symbol's stochastic successors,
+// chosen in proportion to the weights, a rule without one replaces them all
+//
+// Symbols may carry parameters and rules may have a context and a condition
+//   Axiom: A(1, 0.5);
+//   Ignore: +, -;
+//   A(l, w) : l < 8 = F(l, w)[+A(l * 1.5, w * 0.7)]A(l + 1, w);
+//   B < A(l, w) > C = A(l, w)B;
+// a predecessor is a symbol with names for its parameters, optionally with a symbol
+// before it, '<', and a symbol after it, '>', that must be its neighbours. a
+// neighbour skips the symbols listed in Ignore and any branch in between. the
+// condition after ':' and the successor's parameters are expressions of the
+// names using + - * / ^ < > <= >= == != && || ! and brackets. such rules are tried
+// in file order before a symbol's plain rule, and a symbol has the same number of
+// parameters wherever it appears
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+#include <stdarg.h>
+
+namespace octet{
+  /// read only view of a whole file, mapped rather than copied
+  class mapped_file{
+    const char *bytes;
+    size_t length;
+  #ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+  #else
+    int file;
+  #endif
+
+  public:
+    mapped_file() : bytes(0), length(0){
+    #ifdef _WIN32
+      file = mapping = 0;
+    #else
+      file = -1;
+    #endif
+    }
+
+    ~mapped_file(){
+      close();
+    }
+
+    /// maps the file, returns false if it cannot be opened
+    bool open(const char *path){
+      close();
+    #ifdef _WIN32
+      file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+      if (file == INVALID_HANDLE_VALUE){
+        file = 0;
+        return false;
+      }
+      LARGE_INTEGER size;
+      GetFileSizeEx(file, &size);
+      length = (size_t)size.QuadPart;
+      if (length){
+        mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        bytes = mapping ? (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+        if (!bytes){
+          close();
+          return false;
+        }
+      }
+    #else
+      file = ::open(path, O_RDONLY);
+      if (file < 0) return false;
+      struct stat info;
+      if (fstat(file, &info) != 0){
+        close();
+        return false;
+      }
+      length = (size_t)info.st_size;
+      if (length){
+        void *view = mmap(0, length, PROT_READ, MAP_PRIVATE, file, 0);
+        if (view == MAP_FAILED){
+          close();
+          return false;
+        }
+        bytes = (const char *)view;
+      }
+    #endif
+      return true;
+    }
+
+    void close(){
+    #ifdef _WIN32
+      if (bytes) UnmapViewOfFile(bytes);
+      if (mapping) CloseHandle(mapping);
+      if (file) CloseHandle(file);
+      file = mapping = 0;
+    #else
+      if (bytes) munmap((void *)bytes, length);
+      if (file >= 0) ::close(file);
+      file = -1;
+    #endif
+      bytes = 0;
+      length = 0;
+    }
+
+    const char *data() const{
+      return bytes ? bytes : "";
+    }
+
+    size_t size() const{
+      return length;
+    }
+  };
+
+  /// when a file was last written and how big it is, polled to notice that the file has changed
+  struct file_stamp{
+    uint64_t time;
+    uint64_t size;
+
+    file_stamp() : time(0), size(0){
+    }
+
+    /// reads the stamp of the file, returns false if it cannot be found
+    bool read(const char *path){
+    #ifdef _WIN32
+      WIN32_FILE_ATTRIBUTE_DATA info;
+      if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) return false;
+      time = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+      size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    #else
+      struct stat info;
+      if (stat(path, &info) != 0) return false;
+      time = (uint64_t)info.st_mtime * 1000000000ull;
+      #ifdef __linux__
+        // two saves in the same second are told apart by the nanoseconds
+        time += (uint64_t)info.st_mtim.tv_nsec;
+      #endif
+      size = (uint64_t)info.st_size;
+    #endif
+      return true;
+    }
+
+    bool operator==(const file_stamp &other) const{
+      return time == other.time && size == other.size;
+    }
+  };
+
+  /// single pass tokenizer for grammar files, works straight from the file's bytes
+  /// only the symbols of each rule are copied, whitespace never is
+  class L_system_parser{
+  public:
+    /// a rule's successor is length symbols at offset in successors
+    struct rule{
+      char symbol;
+      int offset;
+      int length;
+      float weight;   // 0 for a rule without a weight
+    };
+
+    enum { MAX_PARAMETERS = 16, MAX_EXPRESSION_DEPTH = 16 };
+
+    enum expression_opcode {
+      EX_CONSTANT, EX_PARAMETER, EX_NEGATE, EX_NOT, EX_ADD, EX_SUBTRACT, EX_MULTIPLY, EX_DIVIDE, EX_POWER,
+      EX_LESS, EX_GREATER, EX_LESS_EQUAL, EX_GREATER_EQUAL, EX_EQUAL, EX_NOT_EQUAL, EX_AND, EX_OR
+    };
+
+    /// one step of a compiled expression, evaluated on a stack
+    struct expression_op{
+      uint8_t op;             // expression_opcode
+      uint8_t index;          // the rule's parameter for EX_PARAMETER
+      float value;            // the number for EX_CONSTANT
+    };
+
+    /// an expression is length steps at first in code
+    struct expression{
+      int first;
+      int length;
+    };
+
+    /// a rule with parameters, a condition or a context
+    /// its parameters are the left context's named ones, then the symbol's, then the right context's
+    struct production{
+      char symbol;
+      char left;              // the symbol that must come before it, 0 for any
+      char right;             // the symbol that must come after it, 0 for any
+      uint8_t leftBound;      // parameters named for the left context, 0 or its arity
+      uint8_t rightBound;
+      expression condition;   // length 0 if there is none
+      int offset;             // the successor's symbols in successors
+      int length;
+      int firstArgument;      // an expression in arguments for each parameter of the successor, in order
+      int numArguments;
+    };
+
+    /// runs a compiled expression with the rule's parameters, true is 1 and false 0
+    static float evaluate(const expression_op *code, int length, const float *parameters){
+      float stack[MAX_EXPRESSION_DEPTH];
+      int top = -1;
+      for (int i = 0; i != length; ++i){
+        const expression_op &o = code[i];
+        switch (o.op){
+        case EX_CONSTANT: stack[++top] = o.value; break;
+        case EX_PARAMETER: stack[++top] = parameters[o.index]; break;
+        case EX_NEGATE: stack[top] = -stack[top]; break;
+        case EX_NOT: stack[top] = stack[top] == 0 ? 1.0f : 0.0f; break;
+        default: {
+          float b = stack[top--];
+          float &a = stack[top];
+          switch (o.op){
+          case EX_ADD: a += b; break;
+          case EX_SUBTRACT: a -= b; break;
+          case EX_MULTIPLY: a *= b; break;
+          case EX_DIVIDE: a /= b; break;
+          case EX_POWER: a = powf(a, b); break;
+          case EX_LESS: a = a < b ? 1.0f : 0.0f; break;
+          case EX_GREATER: a = a > b ? 1.0f : 0.0f; break;
+          case EX_LESS_EQUAL: a = a <= b ? 1.0f : 0.0f; break;
+          case EX_GREATER_EQUAL: a = a >= b ? 1.0f : 0.0f; break;
+          case EX_EQUAL: a = a == b ? 1.0f : 0.0f; break;
+          case EX_NOT_EQUAL: a = a != b ? 1.0f : 0.0f; break;
+          case EX_AND: a = a != 0 && b != 0 ? 1.0f : 0.0f; break;
+          default: a = a != 0 || b != 0 ? 1.0f : 0.0f; break;
+          }
+          break;
+        }
+        }
+      }
+      return top >= 0 ? stack[top] : 0;
+    }
+
+  private:
+    const char *cur;
+    const char *end;
+    const char *lineStart;
+    int line;
+    const char *fileName;
+    string error;
+
+    /// the keywords, seen records which have been read
+    enum { KEY_MESSAGE = 1, KEY_ALPHABET = 2, KEY_AXIOM = 4, KEY_RULES = 8, KEY_ANGLE = 16, KEY_ITERATIONS = 32, KEY_IGNORE = 64,
+      NUM_KEYWORDS = 7, REQUIRED_KEYWORDS = 63 };
+    unsigned seen;
+
+    // the parameter names of the rule being read and the depth of the expression being compiled
+    const char *names[MAX_PARAMETERS];
+    int nameLengths[MAX_PARAMETERS];
+    int numNames;
+    int depth;
+    bool tooDeep;
+
+    static const char *keywordName(int index){
+      static const char *names[NUM_KEYWORDS] = { "Message", "Alphabet", "Axiom", "Rules", "Angle", "Iterations", "Ignore" };
+      return names[index];
+    }
+
+    /// notes the error at the current position, always returns false
+    bool fail(const char *fmt, ...){
+      char text[256];
+      va_list args;
+      va_start(args, fmt);
+      vsnprintf(text, sizeof(text), fmt, args);
+      va_end(args);
+      error.format("%s:%d:%d: %s", fileName, line, (int)(cur - lineStart) + 1, text);
+      return false;
+    }
+
+    static bool isSpace(char c){
+      return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static bool isLetter(char c){
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static bool isDigit(char c){
+      return c >= '0' && c <= '9';
+    }
+
+    /// skips whitespace and consumes text if it comes next
+    bool match(const char *text){
+      skipSpace();
+      size_t size = strlen(text);
+      if ((size_t)(end - cur) < size || memcmp(cur, text, size)) return false;
+      cur += size;
+      return true;
+    }
+
+    /// skips whitespace, counting lines for the error messages
+    void skipSpace(){
+      while (cur != end && isSpace(*cur)){
+        if (*cur++ == '\n'){
+          ++line;
+          lineStart = cur;
+        }
+      }
+    }
+
+    /// skips whitespace and consumes c, or fails
+    bool expect(char c, const char *after){
+      skipSpace();
+      if (cur == end || *cur != c){
+        return fail("expected '%c' after %s", c, after);
+      }
+      ++cur;
+      return true;
+    }
+
+    /// reads the symbols up to the next ';', skipping whitespace and optionally commas, into dest
+    bool readSymbols(dynarray<char> &dest, bool commas, const char *what){
+      for (;;){
+        skipSpace();
+        if (cur == end) return fail("missing ';' at the end of %s", what);
+        char c = *cur++;
+        if (c == ';') return true;
+        if (!(commas && c == ',')) dest.push_back(c);
+      }
+    }
+
+    /// reads a number up to the next ';'
+    bool readNumber(double &value, const char *what){
+      skipSpace();
+      char text[64];
+      int size = 0;
+      while (cur != end && *cur != ';' && !isSpace(*cur) && size != sizeof(text) - 1){
+        text[size++] = *cur++;
+      }
+      text[size] = 0;
+      char *last;
+      value = strtod(text, &last);
+      if (!size || *last){
+        cur -= size;
+        return fail("expected a number for %s", what);
+      }
+      return expect(';', what);
+    }
+
+    /// reads the value of a keyword, the ':' has been consumed
+    bool readKeyword(const char *word, int size){
+      int key = 0;
+      for (int i = 0; i != NUM_KEYWORDS; ++i){
+        if ((int)strlen(keywordName(i)) == size && !memcmp(keywordName(i), word, size)) key = 1 << i;
+      }
+      if (!key){
+        cur = word;
+        return fail("unknown keyword '%.*s'", size, word);
+      }
+      if (seen & key){
+        cur = word;
+        return fail("%.*s is given twice", size, word);
+      }
+      seen |= key;
+
+      double value;
+      switch (key){
+      case KEY_MESSAGE: {
+        skipSpace();
+        const char *start = cur;
+        while (cur != end && *cur != ';'){
+          if (*cur++ == '\n'){
+            ++line;
+            lineStart = cur;
+          }
+        }
+        if (cur == end) return fail("missing ';' at the end of the message");
+        const char *last = cur++;
+        while (last != start && isSpace(last[-1])) --last;
+        message.set(start, (int)(last - start));
+        return true;
+      }
+      case KEY_ALPHABET:
+        return readSymbols(alphabet, true, "the alphabet");
+      case KEY_AXIOM: {
+        skipSpace();
+        if (cur == end || *cur == ';') return fail("the axiom must be a single symbol");
+        axiom = *cur++;
+        int firstStep = code.size(), firstArgument = arguments.size(), count;
+        numNames = 0;
+        if (!readArguments(axiom, count)) return false;
+        for (int i = firstArgument; i != arguments.size(); ++i){
+          axiomParameters.push_back(evaluate(&code[arguments[i].first], arguments[i].length, 0));
+        }
+        // the axiom's parameters are numbers, so their code is not kept
+        arguments.resize(firstArgument);
+        code.resize(firstStep);
+        skipSpace();
+        if (cur != end && *cur != ';') return fail("the axiom must be a single symbol");
+        return expect(';', "the axiom");
+      }
+      case KEY_IGNORE:
+        return readSymbols(ignored, true, "Ignore");
+      case KEY_RULES:
+        if (!readNumber(value, "Rules")) return false;
+        declaredRules = (int)value;
+        return true;
+      case KEY_ANGLE:
+        if (!readNumber(value, "Angle")) return false;
+        angle = (float)value;
+        return true;
+      default:
+        if (!readNumber(value, "Iterations")) return false;
+        iterations = (int)value;
+        return true;
+      }
+    }
+
+    /// notes how many parameters a symbol has, or fails if it had a different number before
+    bool setArity(char symbol, int count){
+      int &known = arity[(uint8_t)symbol];
+      if (known < 0){
+        if (count && (symbol == '[' || symbol == ']')) return fail("a bracket cannot have parameters");
+        known = count;
+        return true;
+      }
+      if (known != count) return fail("'%c' has %d parameters here but %d before", symbol, count, known);
+      return true;
+    }
+
+    /// reads the names of a predecessor symbol's parameters, if it has any
+    bool readFormals(int &count){
+      count = 0;
+      skipSpace();
+      if (cur == end || *cur != '(') return true;
+      ++cur;
+      for (;;){
+        skipSpace();
+        const char *start = cur;
+        while (cur != end && (isLetter(*cur) || isDigit(*cur) || *cur == '_')) ++cur;
+        if (cur == start || !isLetter(*start)){
+          cur = start;
+          return fail("expected a parameter name");
+        }
+        if (numNames == MAX_PARAMETERS) return fail("a rule can name at most %d parameters", (int)MAX_PARAMETERS);
+        names[numNames] = start;
+        nameLengths[numNames++] = (int)(cur - start);
+        ++count;
+        if (match(",")) continue;
+        return expect(')', "the parameter names");
+      }
+    }
+
+    /// adds a step to the expression being compiled, tracking the depth of the stack it will need
+    void emit(int op, int index, float value){
+      // the padding is cleared as the code is hashed into cache keys
+      expression_op o;
+      memset(&o, 0, sizeof(o));
+      o.op = (uint8_t)op;
+      o.index = (uint8_t)index;
+      o.value = value;
+      code.push_back(o);
+      if (op == EX_CONSTANT || op == EX_PARAMETER){
+        if (++depth > MAX_EXPRESSION_DEPTH) tooDeep = true;
+      }
+      else if (op != EX_NEGATE && op != EX_NOT){
+        --depth;
+      }
+    }
+
+    /// a number, a parameter name or a bracketed expression
+    bool readAtom(){
+      skipSpace();
+      if (cur == end) return fail("expected an expression");
+      if (*cur == '('){
+        ++cur;
+        return readOr() && expect(')', "the expression");
+      }
+      if (isDigit(*cur) || *cur == '.'){
+        char text[64];
+        int size = 0;
+        while (cur != end && (isDigit(*cur) || *cur == '.' ||
+          ((*cur == 'e' || *cur == 'E') && size) || ((*cur == '-' || *cur == '+') && size && (text[size - 1] == 'e' || text[size - 1] == 'E'))) &&
+          size != sizeof(text) - 1){
+          text[size++] = *cur++;
+        }
+        text[size] = 0;
+        char *last;
+        double value = strtod(text, &last);
+        if (*last){
+          cur -= size;
+          return fail("expected a number");
+        }
+        emit(EX_CONSTANT, 0, (float)value);
+        return true;
+      }
+      if (isLetter(*cur)){
+        const char *start = cur;
+        while (cur != end && (isLetter(*cur) || isDigit(*cur) || *cur == '_')) ++cur;
+        int size = (int)(cur - start);
+        for (int i = numNames; i-- != 0;){
+          if (nameLengths[i] == size && !memcmp(names[i], start, size)){
+            emit(EX_PARAMETER, i, 0);
+            return true;
+          }
+        }
+        cur = start;
+        return fail("unknown parameter '%.*s'", size, start);
+      }
+      return fail("expected an expression");
+    }
+
+    /// x ^ y binds tighter than a sign and to the right
+    bool readPower(){
+      if (!readAtom()) return false;
+      if (!match("^")) return true;
+      if (!readUnary()) return false;
+      emit(EX_POWER, 0, 0);
+      return true;
+    }
+
+    bool readUnary(){
+      if (match("-")){
+        if (!readUnary()) return false;
+        emit(EX_NEGATE, 0, 0);
+        return true;
+      }
+      skipSpace();
+      if (end - cur >= 2 && cur[0] == '!' && cur[1] != '='){
+        ++cur;
+        if (!readUnary()) return false;
+        emit(EX_NOT, 0, 0);
+        return true;
+      }
+      return readPower();
+    }
+
+    bool readProduct(){
+      if (!readUnary()) return false;
+      for (;;){
+        int op = match("*") ? EX_MULTIPLY : match("/") ? EX_DIVIDE : -1;
+        if (op < 0) return true;
+        if (!readUnary()) return false;
+        emit(op, 0, 0);
+      }
+    }
+
+    bool readSum(){
+      if (!readProduct()) return false;
+      for (;;){
+        int op = match("+") ? EX_ADD : match("-") ? EX_SUBTRACT : -1;
+        if (op < 0) return true;
+        if (!readProduct()) return false;
+        emit(op, 0, 0);
+      }
+    }
+
+    /// a single comparison, a < b < c is not allowed
+    bool readComparison(){
+      if (!readSum()) return false;
+      int op = match("<=") ? EX_LESS_EQUAL : match(">=") ? EX_GREATER_EQUAL : match("==") ? EX_EQUAL : match("!=") ? EX_NOT_EQUAL :
+        match("<") ? EX_LESS : match(">") ? EX_GREATER : -1;
+      if (op < 0) return true;
+      if (!readSum()) return false;
+      emit(op, 0, 0);
+      return true;
+    }
+
+    bool readAnd(){
+      if (!readComparison()) return false;
+      while (match("&&")){
+        if (!readComparison()) return false;
+        emit(EX_AND, 0, 0);
+      }
+      return true;
+    }
+
+    bool readOr(){
+      if (!readAnd()) return false;
+      while (match("||")){
+        if (!readAnd()) return false;
+        emit(EX_OR, 0, 0);
+      }
+      return true;
+    }
+
+    /// compiles an expression into code
+    bool readExpression(expression &e){
+      e.first = code.size();
+      depth = 0;
+      tooDeep = false;
+      if (!readOr()) return false;
+      e.length = code.size() - e.first;
+      return !tooDeep || fail("the expression is nested too deeply");
+    }
+
+    /// reads the bracketed expressions after a symbol in a successor or the axiom, if there are any
+    bool readArguments(char symbol, int &count){
+      count = 0;
+      skipSpace();
+      if (cur != end && *cur == '('){
+        ++cur;
+        do{
+          expression e;
+          if (!readExpression(e)) return false;
+          arguments.push_back(e);
+          ++count;
+        } while (match(","));
+        if (!expect(')', "the parameters")) return false;
+      }
+      return setArity(symbol, count);
+    }
+
+    /// reads a successor up to the ';', with an expression for each parameter of its symbols
+    bool readSuccessor(int &offset, int &length, int &numArguments){
+      offset = successors.size();
+      int first = arguments.size();
+      for (;;){
+        skipSpace();
+        if (cur == end) return fail("missing ';' at the end of the rule");
+        char c = *cur++;
+        if (c == ';') break;
+        successors.push_back(c);
+        int count;
+        if (!readArguments(c, count)) return false;
+      }
+      length = successors.size() - offset;
+      numArguments = arguments.size() - first;
+      return true;
+    }
+
+    /// reads a rule, its symbol has been consumed
+    /// the predecessor is [left <] symbol [> right] [: condition], each symbol with optional parameter names
+    bool readRule(char symbol){
+      production p;
+      memset(&p, 0, sizeof(p));
+      numNames = 0;
+      int count, leftCount = 0, rightCount = 0;
+      if (!readFormals(count)) return false;
+      skipSpace();
+      if (cur != end && *cur == '<'){
+        ++cur;
+        skipSpace();
+        if (cur == end) return fail("expected the rule's symbol after '<'");
+        p.left = symbol;
+        leftCount = count;
+        symbol = *cur++;
+        if (!readFormals(count)) return false;
+        skipSpace();
+      }
+      if (!setArity(symbol, count) || (leftCount && !setArity(p.left, leftCount))) return false;
+      if (cur != end && *cur == '>'){
+        ++cur;
+        skipSpace();
+        if (cur == end) return fail("expected a symbol after '>'");
+        p.right = *cur++;
+        if (!readFormals(rightCount) || (rightCount && !setArity(p.right, rightCount))) return false;
+        skipSpace();
+      }
+      p.symbol = symbol;
+      p.leftBound = (uint8_t)leftCount;
+      p.rightBound = (uint8_t)rightCount;
+      if (cur != end && *cur == ':'){
+        ++cur;
+        if (!readExpression(p.condition)) return false;
+      }
+
+      if (!expect('=', "the rule's symbol")) return false;
+      rule r = { symbol, (int)successors.size(), 0, 0 };
+      skipSpace();
+      if (cur != end && *cur == '{'){
+        const char *start = ++cur;
+        char *last;
+        char text[64];
+        int size = 0;
+        while (cur != end && *cur != '}' && *cur != ';' && size != sizeof(text) - 1){
+          text[size++] = *cur++;
+        }
+        text[size] = 0;
+        double weight = strtod(text, &last);
+        while (last != text + size && isSpace(*last)) ++last;
+        if (!size || *last || !(weight > 0)){
+          cur = start;
+          return fail("a rule's weight must be a positive number");
+        }
+        r.weight = (float)weight;
+        if (!expect('}', "the rule's weight")) return false;
+      }
+      if (!readSuccessor(p.offset, p.length, p.numArguments)) return false;
+      p.firstArgument = arguments.size() - p.numArguments;
+
+      if (!p.left && !p.right && !p.condition.length && !count && !p.numArguments){
+        r.offset = p.offset;
+        r.length = p.length;
+        rules.push_back(r);
+        return true;
+      }
+      if (r.weight > 0) return fail("a weighted rule cannot have parameters, a condition or a context");
+      productions.push_back(p);
+      return true;
+    }
+
+  public:
+    // the grammar, valid after parse() returns true
+    string message;
+    dynarray<char> alphabet;
+    char axiom;
+    dynarray<float> axiomParameters;
+    dynarray<char> ignored;       // symbols a context skips
+    dynarray<rule> rules;         // in file order, a later rule for the same symbol replaces an earlier one unless both are weighted
+    dynarray<production> productions;   // the rules with parameters, conditions or contexts, in file order
+    dynarray<char> successors;    // every rule's successor, back to back
+    dynarray<expression> arguments;     // the productions' successor parameters
+    dynarray<expression_op> code;       // every expression, back to back
+    int arity[256];               // parameters of each symbol
+    int declaredRules;
+    float angle;
+    int iterations;
+
+    L_system_parser(){
+      reset();
+    }
+
+    /// empties the grammar so the parser can be used again
+    void reset(){
+      message = "";
+      alphabet.resize(0);
+      axiom = 0;
+      axiomParameters.resize(0);
+      ignored.resize(0);
+      rules.resize(0);
+      productions.resize(0);
+      successors.resize(0);
+      arguments.resize(0);
+      code.resize(0);
+      for (int c = 0; c != 256; ++c){
+        arity[c] = -1;
+      }
+      declaredRules = 0;
+      angle = 0;
+      iterations = 0;
+      seen = 0;
+      error = "";
+    }
+
+    /// reads a grammar from size bytes of text, on failure getError() says what went wrong and where
+    bool parse(const char *name, const char *text, size_t size){
+      reset();
+      cur = lineStart = text;
+      end = text + size;
+      line = 1;
+      fileName = name;
+
+      for (;;){
+        skipSpace();
+        if (cur == end) break;
+
+        // a keyword is a word followed by ':', anything else starts a rule
+        const char *start = cur;
+        while (cur != end && isLetter(*cur)) ++cur;
+        int size = (int)(cur - start);
+        if (size > 1){
+          if (!expect(':', "the keyword") || !readKeyword(start, size)) return false;
+        }
+        else{
+          cur = start + 1;
+          if (!readRule(*start)) return false;
+        }
+      }
+
+      for (int i = 0; i != NUM_KEYWORDS; ++i){
+        if ((REQUIRED_KEYWORDS & (1 << i)) && !(seen & (1 << i))) return fail("missing %s", keywordName(i));
+      }
+      if ((int)(rules.size() + productions.size()) != declaredRules){
+        return fail("Rules says %d but %d rules were given", declaredRules, rules.size() + productions.size());
+      }
+      for (int c = 0; c != 256; ++c){
+        if (arity[c] < 0) arity[c] = 0;
+      }
+      return true;
+    }
+
+    const char *getError() const{
+      return error.c_str();
+    }
+  };
+}
@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// L - System thread pool
+//
+// The threads a tree rewrites and interprets on, and a forest builds its shapes
+// on. A pool starts no threads until the first run that wants more than one and
+// keeps them until it is destroyed, so deriving a generation or rebuilding the
+// mesh in a drag does not start and join a thread per chunk every frame.
+// Jobs are taken from a shared counter, the calling thread working alongside the
+// pool's threads. One run at a time: a tree only runs from its worker or with
+// the worker paused, a forest only from the thread that owns it, and a pool
+// shared by a forest's sources or a tree's detail levels is run by one at a time.
+//
+
+#include <functional>
+
+namespace octet{
+  class L_system_pool{
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;       // a run has started or the pool is stopping
+    std::condition_variable finished;   // the last helper has left a run
+    std::function<void (int, int)> job;
+    std::atomic<int> next;
+    int count;                          // jobs in the current run
+    int helpers;                        // threads the current run wants besides the caller
+    int helping;                        // threads still inside a run
+    unsigned round;                     // bumped by every run, so a thread joins each one once
+    bool isStopping;
+
+    /// takes jobs from the counter until there are none left
+    void work(int thread){
+      for (int i = next++; i < count; i = next++){
+        job(i, thread);
+      }
+    }
+
+    void helperLoop(int index){
+      unsigned seen = 0;
+      std::unique_lock<std::mutex> guard(lock);
+      for (;;){
+        wake.wait(guard, [&]{ return isStopping || (round != seen && index < helpers); });
+        if (isStopping) return;
+        seen = round;
+        ++helping;
+        guard.unlock();
+        work(index + 1);
+        guard.lock();
+        if (--helping == 0) finished.notify_all();
+      }
+    }
+
+  public:
+    L_system_pool() : next(0), count(0), helpers(0), helping(0), round(0), isStopping(false) {
+    }
+
+    ~L_system_pool(){
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        isStopping = true;
+        wake.notify_all();
+      }
+      for (size_t i = 0; i != threads.size(); ++i){
+        threads[i].join();
+      }
+    }
+
+    /// threads started so far, not counting the callers
+    int getThreads() const{
+      return (int)threads.size();
+    }
+
+    /// runs fn(i, thread) for i in [0, jobs) on up to numThreads threads, the caller being thread 0, and returns once all are done
+    /// a job may wait for another job to make progress only if numThreads is at least jobs
+    template <class job_t> void run(int jobs, int numThreads, job_t fn){
+      if (numThreads > jobs) numThreads = jobs;
+      if (numThreads <= 1){
+        for (int i = 0; i < jobs; ++i){
+          fn(i, 0);
+        }
+        return;
+      }
+
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        // a thread woken by the last run may still be on its way out
+        finished.wait(guard, [&]{ return helping == 0; });
+        while ((int)threads.size() < numThreads - 1){
+          threads.push_back(std::thread(&L_system_pool::helperLoop, this, (int)threads.size()));
+        }
+        job = fn;
+        count = jobs;
+        next = 0;
+        helpers = numThreads - 1;
+        ++round;
+        wake.notify_all();
+      }
+
+      work(0);
+
+      std::unique_lock<std::mutex> guard(lock);
+      finished.wait(guard, [&]{ return helping == 0; });
+    }
+  };
+}
@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// L - System profiling
+//
+// Times each phase of building a tree and keeps the counters that go with it:
+//   parse       reading the grammar file
+//   derive      one generation of rewriting, tagged with the generation
+//   count       the symbol pre-count in initialiseDrawParams()
+//   interpret   walking the turtle over the axiom
+//   upload      copying the mesh to the GPU
+// Phases are timed as a whole, never per symbol, and the counters are read from
+// totals the build already has. Build with LS_PROFILE 0 and the macros below
+// expand to nothing, so neither the clock nor the counters cost anything.
+//
+// The debug switches for the parser and the rewrite are here too, shared by the
+// tree and the app. They print what was parsed and the size and start of each
+// generation, so they can be turned on from the build as -DLS_DEBUG_ITERATE=1.
+//
+
+#ifndef LS_PROFILE
+  #define LS_PROFILE 1
+#endif
+
+#ifndef LS_DEBUG_PARSER
+  #define LS_DEBUG_PARSER 0
+#endif
+
+#ifndef LS_DEBUG_ITERATE
+  #define LS_DEBUG_ITERATE 0
+#endif
+
+#if LS_PROFILE
+  // times the rest of the enclosing block as one phase
+  #define LS_PROFILE_PHASE(profile, phase, generation) octet::L_system_profile::scope lsProfileScope((profile), (phase), (generation))
+  // sets a counter, the value is not evaluated when profiling is compiled out
+  #define LS_PROFILE_COUNT(profile, counter, value) (profile).setCounter((counter), (uint64_t)(value))
+#else
+  #define LS_PROFILE_PHASE(profile, phase, generation) ((void)0)
+  #define LS_PROFILE_COUNT(profile, counter, value) ((void)0)
+#endif
+
+namespace octet{
+  /// Phase timers and counters of one tree, safe to record from the worker thread while the app reads them
+  class L_system_profile{
+  public:
+    enum phase { PHASE_PARSE, PHASE_DERIVE, PHASE_COUNT, PHASE_INTERPRET, PHASE_UPLOAD, NUM_PHASES };
+
+    enum counter { COUNT_SYMBOLS, COUNT_SEGMENTS, COUNT_VERTICES, COUNT_BYTES, COUNT_STACK_DEPTH, NUM_COUNTERS };
+
+    /// the events kept for the trace, the oldest are overwritten
+    enum { MAX_EVENTS = 1 << 12, MAX_GENERATIONS = 64 };
+
+    /// a phase's timings
+    struct phase_stats{
+      uint64_t calls;
+      double lastMs;
+      double totalMs;
+      double maxMs;
+    };
+
+    /// one timed phase, with the counters as they were when it finished
+    struct event{
+      uint8_t phase;
+      int generation;
+      uint32_t thread;
+      double startUs;         // from when the profile was made
+      double durationUs;
+      uint64_t counters[NUM_COUNTERS];
+    };
+
+    typedef std::chrono::high_resolution_clock clock;
+
+    /// times a phase from its construction to the end of its scope
+    struct scope{
+      L_system_profile &owner;
+      int phase;
+      int generation;
+      clock::time_point start;
+
+      scope(L_system_profile &owner, int phase, int generation) : owner(owner), phase(phase), generation(generation), start(clock::now()){
+      }
+
+      ~scope(){
+        owner.record(phase, generation, start, clock::now());
+      }
+    };
+
+  private:
+    mutable std::mutex lock;
+    clock::time_point epoch;
+    phase_stats phases[NUM_PHASES];
+    double generationMs[MAX_GENERATIONS];   // the last derivation of each generation
+    uint64_t counters[NUM_COUNTERS];
+    dynarray<event> events;
+    uint64_t numEvents;
+
+    static const char *phaseName(int index){
+      static const char *names[NUM_PHASES] = { "parse", "derive", "count", "interpret", "upload" };
+      return names[index];
+    }
+
+    static const char *counterName(int index){
+      static const char *names[NUM_COUNTERS] = { "symbols", "segments", "vertices", "bytes", "stack depth" };
+      return names[index];
+    }
+
+    /// a small number for the calling thread, the trace viewer draws a row for each
+    static uint32_t threadId(){
+      return (uint32_t)(std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000);
+    }
+
+  public:
+    L_system_profile(){
+      reset();
+    }
+
+    /// forgets every timing, counter and event
+    void reset(){
+      std::lock_guard<std::mutex> guard(lock);
+      epoch = clock::now();
+      memset(phases, 0, sizeof(phases));
+      memset(generationMs, 0, sizeof(generationMs));
+      memset(counters, 0, sizeof(counters));
+      events.reset();
+      numEvents = 0;
+    }
+
+    void setCounter(int index, uint64_t value){
+      std::lock_guard<std::mutex> guard(lock);
+      counters[index] = value;
+    }
+
+    /// adds a finished phase to its totals and to the trace
+    void record(int index, int generation, clock::time_point start, clock::time_point end){
+      double ms = std::chrono::duration<double, std::milli>(end - start).count();
+      std::lock_guard<std::mutex> guard(lock);
+      phase_stats &p = phases[index];
+      ++p.calls;
+      p.lastMs = ms;
+      p.totalMs += ms;
+      if (ms > p.maxMs) p.maxMs = ms;
+      if (index == PHASE_DERIVE && generation >= 0 && generation < MAX_GENERATIONS) generationMs[generation] = ms;
+
+      // the ring grows to its size as events come in, a tree built once keeps only what it used
+      if (events.size() != MAX_EVENTS) events.resize(events.size() + 1);
+      event &e = events[(int)(numEvents++ % MAX_EVENTS)];
+      e.phase = (uint8_t)index;
+      e.generation = generation;
+      e.thread = threadId();
+      e.startUs = std::chrono::duration<double, std::micro>(start - epoch).count();
+      e.durationUs = ms * 1000;
+      memcpy(e.counters, counters, sizeof(counters));
+    }
+
+    phase_stats getPhase(int index) const{
+      std::lock_guard<std::mutex> guard(lock);
+      return phases[index];
+    }
+
+    uint64_t getCounter(int index) const{
+      std::lock_guard<std::mutex> guard(lock);
+      return counters[index];
+    }
+
+    /// the time the last derivation of a generation took, 0 if it has not been derived
+    double getGenerationMs(int generation) const{
+      std::lock_guard<std::mutex> guard(lock);
+      return generation >= 0 && generation < MAX_GENERATIONS ? generationMs[generation] : 0;
+    }
+
+    /// writes the last time of each phase and the counters as lines of text, for an overlay or the console
+    void format(char *text, size_t size) const{
+      std::lock_guard<std::mutex> guard(lock);
+      size_t used = 0;
+      for (int i = 0; i != NUM_PHASES + NUM_COUNTERS && used < size; ++i){
+        int written = i < NUM_PHASES ?
+          snprintf(text + used, size - used, "%-10s %8.2f ms  max %8.2f ms  x%llu\n", phaseName(i), phases[i].lastMs, phases[i].maxMs, (unsigned long long)phases[i].calls) :
+          snprintf(text + used, size - used, "%-10s %llu\n", counterName(i - NUM_PHASES), (unsigned long long)counters[i - NUM_PHASES]);
+        if (written < 0) break;
+        used += written;
+      }
+    }
+
+    /// writes the events as a Chrome trace, chrome://tracing or Perfetto open it, with the phase totals under otherData
+    bool writeTrace(const char *path) const{
+      FILE *file = fopen(path, "w");
+      if (!file) return false;
+      std::lock_guard<std::mutex> guard(lock);
+
+      fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+      uint64_t count = numEvents < MAX_EVENTS ? numEvents : (uint64_t)MAX_EVENTS;
+      for (uint64_t n = 0; n != count; ++n){
+        const event &e = events[(int)((numEvents - count + n) % MAX_EVENTS)];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"L_system\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"generation\":%d}},\n",
+          phaseName(e.phase), e.thread, e.startUs, e.durationUs, e.generation);
+        fprintf(file, "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", e.startUs + e.durationUs);
+        for (int i = 0; i != NUM_COUNTERS; ++i){
+          fprintf(file, "%s\"%s\":%llu", i ? "," : "", counterName(i), (unsigned long long)e.counters[i]);
+        }
+        fprintf(file, "}}%s\n", n + 1 != count ? "," : "");
+      }
+
+      fprintf(file, "],\"otherData\":{");
+      for (int i = 0; i != NUM_PHASES; ++i){
+        const phase_stats &p = phases[i];
+        fprintf(file, "\"%s\":{\"calls\":%llu,\"lastMs\":%.4f,\"totalMs\":%.4f,\"maxMs\":%.4f},", phaseName(i),
+          (unsigned long long)p.calls, p.lastMs, p.totalMs, p.maxMs);
+      }
+      fprintf(file, "\"generationMs\":[");
+      for (int g = 0; g != MAX_GENERATIONS; ++g){
+        fprintf(file, "%s%.4f", g ? "," : "", generationMs[g]);
+      }
+      fprintf(file, "]}}\n");
+      return fclose(file) == 0;
+    }
+  };
+}
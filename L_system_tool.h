@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Octet: (C) Andy Thomason 2012-2014
+//
+// Command line helpers shared by the L - System batch generator and benchmark
+//
+
+#include "L_system.h"
+
+namespace octet {
+  /// reads the arguments the command line tools have in common
+  class L_system_tool {
+  public:
+    /// parses "3,5-7" into 3 5 6 7
+    static bool parseList(const char *arg, dynarray<int> &values){
+      values.resize(0);
+      const char *p = arg;
+      while (*p){
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) return false;
+        long last = first;
+        p = end;
+        if (*p == '-'){
+          last = strtol(p + 1, &end, 10);
+          if (end == p + 1 || last < first) return false;
+          p = end;
+        }
+        for (long i = first; i <= last; ++i){
+          values.push_back((int)i);
+        }
+        if (*p == ',') ++p;
+        else if (*p) return false;
+      }
+      return values.size() != 0;
+    }
+
+    /// the file name without its directory or extension
+    static string baseName(const char *path){
+      const char *start = path;
+      for (const char *p = path; *p; ++p){
+        if (*p == '/' || *p == '\\') start = p + 1;
+      }
+      const char *end = strrchr(start, '.');
+      if (!end) end = start + strlen(start);
+      string name;
+      name.format("%.*s", (int)(end - start), start);
+      return name;
+    }
+  };
+}